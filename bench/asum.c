@@ -1,4 +1,5 @@
 #include <cl_utils.h>
+#include <fill.h>
 #include <reduce.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,12 +26,7 @@ main (int argc, const char **argv)
 
   int n = atoi (argv[1]);
   array A = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, n);
-  int i = 0;
-  for (; i < ARRAY_SIZE (A); i++)
-    {
-      A.floats[i] = (float)i + 1;
-    }
-  SYNC_ARRAY_TO_DEVICE (A);
+  IOTA (A, 1, 1);
 
   unsigned long long total = 0;
   for (int i = 0; i < WARMUP_ITERS; i++)
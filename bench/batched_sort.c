@@ -0,0 +1,59 @@
+#include <batched_sort.h>
+#include <cl_utils.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WARMUP_ITERS 100
+#define ITERS 1000
+
+int
+main (int argc, const char **argv)
+{
+  cl_platform_id platform;
+  cl_device_id device;
+  cl_context context;
+  cl_command_queue queue;
+  const cl_queue_properties props[]
+      = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+  setup_cl (&platform, &device, &context, &queue, props);
+
+  if (argc != 3)
+    {
+      fprintf (stderr, "Usage:\n  %s SEGMENT_LENGTH NUM_SEGMENTS", argv[0]);
+      return 1;
+    }
+
+  int n = atoi (argv[1]);
+  int m = atoi (argv[2]);
+  array K = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, n, m);
+  array V = ALLOC_ARRAY (int, CL_MEM_READ_WRITE, n, m);
+  for (int i = 0; i < ARRAY_SIZE (K); i++)
+    {
+      K.floats[i] = (float)rand () / RAND_MAX;
+      V.ints[i] = i;
+    }
+  SYNC_ARRAY_TO_DEVICE (K);
+  SYNC_ARRAY_TO_DEVICE (V);
+
+  unsigned long long total = 0;
+  for (int i = 0; i < WARMUP_ITERS; i++)
+    {
+      BATCHED_SORT_BY_KEY ("a < b", K, V);
+    }
+  for (int i = 0; i < ITERS; i++)
+    {
+      total += BATCHED_SORT_BY_KEY ("a < b", K, V);
+    }
+  printf ("%d Iterations with %d segments of %d %s(%zu bytes)\n", ITERS, m, n,
+          TYPE_STR_FROM_ENUM (K.type), SIZE_FROM_ENUM (K.type));
+  printf ("  Average time: %lf ms\n", (total / (double)ITERS) / 1e6);
+  double avg_time_sec = ((double)total / ITERS) / 1e9;
+  double mkeys = ((double)n * m) / avg_time_sec / 1e6;
+  printf ("  Estimated Mkeys/s: %lf\n", mkeys);
+
+  FREE_ARRAY (K);
+  FREE_ARRAY (V);
+  release_cl (&device, &context, &queue);
+
+  return 0;
+}
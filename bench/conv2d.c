@@ -0,0 +1,70 @@
+#include <cl_utils.h>
+#include <conv2d.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WARMUP_ITERS 10
+#define ITERS 100
+
+int
+main (int argc, const char **argv)
+{
+  cl_platform_id platform;
+  cl_device_id device;
+  cl_context context;
+  cl_command_queue queue;
+  const cl_queue_properties props[]
+      = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+  setup_cl (&platform, &device, &context, &queue, props);
+
+  if (argc != 5)
+    {
+      fprintf (stderr,
+               "Usage:\n  %s IMAGE_SIZE IN_CHANNELS OUT_CHANNELS FILTER_SIZE",
+               argv[0]);
+      return 1;
+    }
+
+  int n = atoi (argv[1]);
+  int cin = atoi (argv[2]);
+  int cout = atoi (argv[3]);
+  int k = atoi (argv[4]);
+  array X = ALLOC_ARRAY (float, CL_MEM_READ_ONLY, n, n, cin);
+  array F = ALLOC_ARRAY (float, CL_MEM_READ_ONLY, k, k, cin * cout);
+  array Y = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, n, n, cout);
+  for (int i = 0; i < ARRAY_SIZE (X); i++)
+    {
+      X.floats[i] = (float)(i & 255) / 256;
+    }
+  for (int i = 0; i < ARRAY_SIZE (F); i++)
+    {
+      F.floats[i] = (float)(i & 15) / 16;
+    }
+  SYNC_ARRAY_TO_DEVICE (X);
+  SYNC_ARRAY_TO_DEVICE (F);
+
+  unsigned long long total = 0;
+  for (int i = 0; i < WARMUP_ITERS; i++)
+    {
+      CONV2D ("+", "*", 1, k / 2, X, F, Y);
+    }
+  for (int i = 0; i < ITERS; i++)
+    {
+      total += CONV2D ("+", "*", 1, k / 2, X, F, Y);
+    }
+  printf ("%d Iterations with %dx%dx%d image and %d %dx%d filters of "
+          "%s(%zu bytes)\n",
+          ITERS, n, n, cin, cout, k, k, TYPE_STR_FROM_ENUM (Y.type),
+          SIZE_FROM_ENUM (Y.type));
+  printf ("  Average time: %lf ms\n", (total / (double)ITERS) / 1e6);
+  double avg_time_sec = ((double)total / ITERS) / 1e9;
+  double gflops = (2.0 * n * n * cout * cin * k * k) / avg_time_sec / 1e9;
+  printf ("  Estimated GFLOPS: %lf\n", gflops);
+
+  FREE_ARRAY (X);
+  FREE_ARRAY (F);
+  FREE_ARRAY (Y);
+  release_cl (&device, &context, &queue);
+
+  return 0;
+}
@@ -1,4 +1,5 @@
 #include <cl_utils.h>
+#include <fill.h>
 #include <inner_product.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,20 +25,11 @@ main (int argc, const char **argv)
     }
 
   int n = atoi (argv[1]);
-  array A = ALLOC_ARRAY (float, CL_MEM_READ_ONLY, n, n);
-  array B = ALLOC_ARRAY (float, CL_MEM_READ_ONLY, n, n);
+  array A = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, n, n);
+  array B = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, n, n);
   array C = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, n, n);
-  int i = 0;
-  for (; i < ARRAY_SIZE (A); i++)
-    {
-      A.floats[i] = (float)i + 1;
-    }
-  for (int j = 0; j < ARRAY_SIZE (A); j++)
-    {
-      B.floats[j] = (float)++i;
-    }
-  SYNC_ARRAY_TO_DEVICE (A);
-  SYNC_ARRAY_TO_DEVICE (B);
+  IOTA (A, 1, 1);
+  IOTA (B, ARRAY_SIZE (A) + 1, 1);
 
   unsigned long long total = 0;
   for (int i = 0; i < WARMUP_ITERS; i++)
@@ -52,11 +52,29 @@ main (int argc, const char **argv)
           TYPE_STR_FROM_ENUM (B.type), SIZE_FROM_ENUM (B.type));
   printf ("  Average time: %lf ms\n", (total / (double)ITERS) / 1e6);
   double avg_time_sec = ((double)total / ITERS) / 1e9;
-  double gflops = (n * n) / avg_time_sec / 1e9;
+  double gflops = ((double)n * n) / avg_time_sec / 1e9;
   printf ("  Estimated GFLOPS: %lf\n", gflops);
+  // Every element of C is stored once, which dominates the traffic.
+  double bandwidth
+      = ((double)n * n * SIZE_FROM_ENUM (C.type)) / avg_time_sec / 1e9;
+  printf ("  Store bandwidth: %lf GB/s\n", bandwidth);
+
+  SYNC_ARRAY_FROM_DEVICE (C);
+  for (int row = 0; row < n; row++)
+    {
+      for (int col = 0; col < n; col++)
+        {
+          if (C.floats[row * n + col] != A.floats[row] * B.floats[col])
+            {
+              fprintf (stderr, "Wrong product at %d, %d\n", row, col);
+              return 1;
+            }
+        }
+    }
 
   FREE_ARRAY (A);
   FREE_ARRAY (B);
+  FREE_ARRAY (C);
   release_cl (&device, &context, &queue);
 
   return 0;
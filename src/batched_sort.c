@@ -0,0 +1,190 @@
+#include "batched_sort.h"
+#include "cl_utils.h"
+#include <stdio.h>
+
+/* Format strings:
+** 1. K type
+** 2. V type
+** 3. width
+** 4. has_values
+** 5. has_offsets
+** 6. K_seg type
+** 7. V_seg type
+** 8. a type
+** 9. b type
+** 10. OP1
+** 11. a type
+** 12. b type
+** 13. OP1
+*/
+const char *_batched_sort_fmt = RAW (__kernel void entry (
+    const int k1, const int k2, const int k3, __global % s * K,
+    const int v1, const int v2, const int v3, __global % s * V,
+    const int o1, const int o2, const int o3, __global const int *O) {
+  int seg = get_group_id (0);
+  int local_id = get_local_id (0);
+  int local_size = get_local_size (0);
+
+  const int width = % d;
+  const int has_values = % d;
+  const int has_offsets = % d;
+  __local % s K_seg[width];
+  __local % s V_seg[has_values ? width : 1];
+  __local int perm[width];
+
+  int start = has_offsets ? O[seg] : seg * k1;
+  int n = has_offsets ? O[seg + 1] - start : k1;
+  if (n < 0 || n > width || start < 0 || start + n > k1 * k2 * k3
+      || (has_values && start + n > v1 * v2 * v3))
+    return;
+
+  for (int i = local_id; i < width; i += local_size)
+    {
+      perm[i] = i;
+      if (i < n)
+        {
+          K_seg[i] = K[start + i];
+          if (has_values)
+            {
+              V_seg[i] = V[start + i];
+            }
+        }
+    }
+  barrier (CLK_LOCAL_MEM_FENCE);
+
+  // Bitonic network over positions, padding sorts after every element and
+  // ties are broken by position so the sort is stable.
+  for (int k = 2; k <= width; k <<= 1)
+    {
+      for (int j = k >> 1; j > 0; j >>= 1)
+        {
+          for (int t = local_id; t < width / 2; t += local_size)
+            {
+              int lo = 2 * (t & ~(j - 1)) + (t & (j - 1));
+              int hi = lo + j;
+              int p = perm[lo];
+              int q = perm[hi];
+
+              bool q_first = p >= n && (q < n || q < p);
+              if (p < n && q < n)
+                {
+                  {
+                    % s a = K_seg[q];
+                    % s b = K_seg[p];
+                    q_first = % s;
+                  }
+                  if (!q_first && q < p)
+                    {
+                      % s a = K_seg[p];
+                      % s b = K_seg[q];
+                      q_first = !(% s);
+                    }
+                }
+
+              if (((lo & k) == 0) == q_first)
+                {
+                  perm[lo] = q;
+                  perm[hi] = p;
+                }
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+    }
+
+  for (int i = local_id; i < n; i += local_size)
+    {
+      K[start + i] = K_seg[perm[i]];
+      if (has_values)
+        {
+          V[start + i] = V_seg[perm[i]];
+        }
+    }
+});
+
+char *
+get_batched_sort (const char *ktype, const char *vtype, const char *op1,
+                  int width, int has_values, int has_offsets)
+{
+  int size = snprintf (NULL, 0, _batched_sort_fmt, ktype, vtype, width,
+                       has_values, has_offsets, ktype, vtype, ktype, ktype,
+                       op1, ktype, ktype, op1);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _batched_sort_fmt, ktype, vtype,
+                        width, has_values, has_offsets, ktype, vtype, ktype,
+                        ktype, op1, ktype, ktype, op1);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+batched_sort (const char *op1, array K, array *V, array *O, int max_length,
+              cl_event *event)
+{
+  cl_event _event;
+  int segments = K.dim2 * K.dim3;
+  if (O)
+    {
+      if (O->type != TYPE_INT)
+        {
+          handle_error ("Segment offsets must be an array of int");
+          return 0;
+        }
+      segments = ARRAY_SIZE ((*O)) - 1;
+    }
+  else
+    {
+      max_length = K.dim1;
+    }
+  if (max_length > BATCHED_SORT_MAX_LENGTH)
+    {
+      handle_error ("Segment of length %d exceeds BATCHED_SORT_MAX_LENGTH %d",
+                    max_length, BATCHED_SORT_MAX_LENGTH);
+      return 0;
+    }
+  if (segments < 1 || max_length < 1)
+    return 0;
+
+  int width = 1;
+  while (width < max_length)
+    width <<= 1;
+
+  const char *ktype = TYPE_STR_FROM_ENUM (K.type);
+  const char *vtype = V ? TYPE_STR_FROM_ENUM (V->type) : ktype;
+  char *src
+      = get_batched_sort (ktype, vtype, op1, width, V != NULL, O != NULL);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  SET_KERNEL_ARGS (kernel, K, V ? *V : K, O ? *O : K);
+
+  // Work items loop over the network, so cap the group at a tile's worth.
+  size_t local_size[] = { width / 2 };
+  if (local_size[0] < 1)
+    local_size[0] = 1;
+  if (local_size[0] > (size_t)(_tile_size * _tile_size))
+    local_size[0] = _tile_size * _tile_size;
+  size_t global_size[] = { segments * local_size[0] };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    event ? event : &_event));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
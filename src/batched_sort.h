@@ -0,0 +1,112 @@
+/**
+ * @file batched_sort.h
+ */
+
+#ifndef BATCHED_SORT_H_
+#define BATCHED_SORT_H_
+
+#include "cl_utils.h"
+
+/**
+ * @brief Longest segment supported by batched sorts, can be overriden.
+ *
+ * Every segment is sorted within a single work group in local memory, so this
+ * bounds the local memory used per work group.
+ */
+#ifndef BATCHED_SORT_MAX_LENGTH
+#define BATCHED_SORT_MAX_LENGTH 1024
+#endif
+
+extern const char *_batched_sort_fmt;
+/**
+ * @brief Composes batched sort kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Each work group sorts one segment of K in local memory with a bitonic
+ * sorting network, reordering V alongside K if has_values is set. Segments
+ * are delimited by the offsets in O if has_offsets is set, otherwise each
+ * segment is a row of K. Variables `a` and `b` hold a pair of keys, and op1
+ * must evaluate to true when `a` goes before `b`.
+ *
+ * @param ktype String for type of first @ref array of kernel: K.
+ * @param vtype String for type of second @ref array of kernel: V.
+ * @param op1 String for the comparison the kernel sorts by.
+ * @param width Power of two no smaller than the longest segment.
+ * @param has_values Whether V is reordered alongside K.
+ * @param has_offsets Whether segments are delimited by O.
+ * @return Pointer to null-terminated string.
+ */
+char *get_batched_sort (const char *ktype, const char *vtype, const char *op1,
+                        int width, int has_values, int has_offsets);
+/**
+ * @brief Perform batched sort operation.
+ *
+ * Sorts every segment of K in a single kernel call. Segments are the rows of
+ * K, or the ranges `[O[i], O[i + 1])` if offsets are given. If values are
+ * given, they are reordered alongside their keys. The sort is stable.
+ * Offsets stay on the device, so the longest segment must be given. Segments
+ * longer than that may be left unsorted, and reversed segments or segments
+ * reaching past the end of K or V are left untouched. Blocks and attempts to
+ * record timing if no cl_event is provided, non blocking otherwise.
+ *
+ * @param op1 String of comparison to sort by.
+ * @param K @ref array of keys to sort.
+ * @param V Optional. @ref array of values to reorder with K, or NULL.
+ * @param O Optional. @ref array of int segment offsets, or NULL.
+ * @param max_length Longest segment if offsets are given, ignored otherwise.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * The input operation is evaluated on pairs of keys, within the scope of which
+ * the variables `a` and `b` exist that hold the keys being compared, and must
+ * be true when `a` goes before `b`.
+ * @code
+ * // Sort each row of A in ascending order
+ * BATCHED_SORT("a < b", A);
+ * // Sort each row of scores in descending order, carrying ids along
+ * cl_event event;
+ * BATCHED_SORT_BY_KEY("a > b", scores, ids, &event);
+ * clWaitForEvents(1, &event);
+ * // Sort the segments of A, none longer than 64, delimited by the int array
+ * // offsets
+ * SEGMENTED_SORT("a < b", A, offsets, 64);
+ * @endcode
+ */
+unsigned long long batched_sort (const char *op1, array K, array *V, array *O,
+                                 int max_length, cl_event *event);
+#define _BATCHED_SORT_ONE(op1, K) batched_sort (op1, K, NULL, NULL, 0, NULL);
+#define _BATCHED_SORT_TWO(op1, K, event)                                      \
+  batched_sort (op1, K, NULL, NULL, 0, event)
+#define BATCHED_SORT(...)                                                     \
+  _GETM_THREE (__VA_ARGS__, _BATCHED_SORT_TWO,                                \
+               _BATCHED_SORT_ONE) (__VA_ARGS__) /**< @copydoc batched_sort*/
+#define _BATCHED_SORT_BY_KEY_ONE(op1, K, V)                                   \
+  batched_sort (op1, K, &(V), NULL, 0, NULL);
+#define _BATCHED_SORT_BY_KEY_TWO(op1, K, V, event)                            \
+  batched_sort (op1, K, &(V), NULL, 0, event)
+#define BATCHED_SORT_BY_KEY(...)                                              \
+  _GETM_FOUR (__VA_ARGS__, _BATCHED_SORT_BY_KEY_TWO,                          \
+              _BATCHED_SORT_BY_KEY_ONE) (                                     \
+      __VA_ARGS__) /**< @copydoc batched_sort */
+#define _SEGMENTED_SORT_ONE(op1, K, O, max_length)                            \
+  batched_sort (op1, K, NULL, &(O), max_length, NULL);
+#define _SEGMENTED_SORT_TWO(op1, K, O, max_length, event)                     \
+  batched_sort (op1, K, NULL, &(O), max_length, event)
+#define SEGMENTED_SORT(...)                                                   \
+  _GETM_FIVE (__VA_ARGS__, _SEGMENTED_SORT_TWO,                               \
+              _SEGMENTED_SORT_ONE) (__VA_ARGS__) /**< @copydoc batched_sort*/
+#define _SEGMENTED_SORT_BY_KEY_ONE(op1, K, V, O, max_length)                  \
+  batched_sort (op1, K, &(V), &(O), max_length, NULL);
+#define _SEGMENTED_SORT_BY_KEY_TWO(op1, K, V, O, max_length, event)           \
+  batched_sort (op1, K, &(V), &(O), max_length, event)
+#define SEGMENTED_SORT_BY_KEY(...)                                            \
+  _GETM_SIX (__VA_ARGS__, _SEGMENTED_SORT_BY_KEY_TWO,                         \
+             _SEGMENTED_SORT_BY_KEY_ONE) (                                    \
+      __VA_ARGS__) /**< @copydoc batched_sort */
+
+#endif // BATCHED_SORT_H_
@@ -1,5 +1,6 @@
 #include "cl_utils.h"
 #include <CL/cl.h>
+#include <ctype.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -488,15 +489,53 @@ _check_cl (cl_int err, const char *expr, int line, const char *file)
     }
 }
 
+const char *_complex_fmt = RAW (
+    float2 cmulf (float2 a, float2 b) {
+      return (float2)(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+    }
+
+    float2 cdivf (float2 a, float2 b) {
+      float d = b.x * b.x + b.y * b.y;
+      return (float2)((a.x * b.x + a.y * b.y) / d,
+                      (a.y * b.x - a.x * b.y) / d);
+    }
+
+    float2 cconjf (float2 a) { return (float2)(a.x, -a.y); });
+
+/*
+** Only defined for kernels using them, so devices without fp64 still
+** compile the others. The pragma starts its own line, after whatever source
+** precedes it.
+*/
+const char *_complex_double_fmt
+    = "\n#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n" RAW (
+        double2 cmuld (double2 a, double2 b) {
+          return (double2)(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+        }
+
+        double2 cdivd (double2 a, double2 b) {
+          double d = b.x * b.x + b.y * b.y;
+          return (double2)((a.x * b.x + a.y * b.y) / d,
+                           (a.y * b.x - a.x * b.y) / d);
+        }
+
+        double2 cconjd (double2 a) { return (double2)(a.x, -a.y); });
+
 cl_kernel
 try_compile_kernel (const char *src, const char *kernel_name,
                     cl_context context, cl_device_id device)
 {
+  const char *sources[] = { "", "", src };
+  if (strstr (src, "cmulf") || strstr (src, "cdivf") || strstr (src, "cconjf"))
+    sources[0] = _complex_fmt;
+  if (strstr (src, "cmuld") || strstr (src, "cdivd") || strstr (src, "cconjd"))
+    sources[1] = _complex_double_fmt;
+
   cl_int err;
   cl_program program = CHECK_CL (
-      clCreateProgramWithSource (context, 1, (const char **)&src, NULL, &err),
-      err);
-  err = clBuildProgram (program, 1, &device, NULL, NULL, NULL);
+      clCreateProgramWithSource (context, 3, sources, NULL, &err), err);
+  err = clBuildProgram (program, 1, &device, KERNEL_BUILD_OPTIONS, NULL,
+                        NULL);
   if (err != CL_SUCCESS)
     {
       cl_build_status status;
@@ -555,6 +594,30 @@ set_kernel_args (cl_kernel kernel, int num_args, ...)
   return arg_index;
 }
 
+char *
+get_op_expression (const char *op)
+{
+  const char *fmt
+      = (isalpha ((unsigned char)op[0]) || op[0] == '_') ? "%s (a, b)"
+                                                          : "a %s b";
+  int size = snprintf (NULL, 0, fmt, op);
+
+  char *expression = malloc (size + 1);
+  if (!expression)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+      return NULL;
+    }
+
+  int count = snprintf (expression, size + 1, fmt, op);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return expression;
+}
+
 unsigned long long int
 get_cl_event_time (cl_event event)
 {
@@ -693,6 +756,26 @@ free_array (array arr)
   CHECK_CL (clReleaseMemObject (arr.device));
 }
 
+/*
+** Complex elements print their real and imaginary parts, any other element
+** is handed to printf as is.
+*/
+static void
+print_cfloat (const char *format, cfloat v)
+{
+  printf (format, v.s[0], v.s[1]);
+}
+
+static void
+print_cdouble (const char *format, cdouble v)
+{
+  printf (format, v.s[0], v.s[1]);
+}
+
+#define PRINT_ELEMENT(format, v)                                              \
+  _Generic ((v), cfloat: print_cfloat, cdouble: print_cdouble,                \
+            default: printf) (format, v)
+
 void
 print_array (array arr)
 {
@@ -706,7 +789,7 @@ print_array (array arr)
                 {
 #define X(_, enum_name, name, format)                                         \
   case enum_name:                                                             \
-    printf (", " format, arr.name[i + arr.dim1 * (j + arr.dim2 * k)]);        \
+    PRINT_ELEMENT (", " format, arr.name[i + arr.dim1 * (j + arr.dim2 * k)]); \
     break;
                   _TYPE_LIST
 #undef X
@@ -28,6 +28,8 @@
 #define _GETM_FOUR(_1, _2, _3, _4, NAME, ...) NAME
 #define _GETM_FIVE(_1, _2, _3, _4, _5, NAME, ...) NAME
 #define _GETM_SIX(_1, _2, _3, _4, _5, _6, NAME, ...) NAME
+#define _GETM_SEVEN(_1, _2, _3, _4, _5, _6, _7, NAME, ...) NAME
+#define _GETM_EIGHT(_1, _2, _3, _4, _5, _6, _7, _8, NAME, ...) NAME
 
 /**
  * @brief Library error handler signature.
@@ -219,9 +221,33 @@ void _check_cl (cl_int err, const char *expr, int line, const char *file);
 #define CHECK_CL(...)                                                         \
   _GETM_TWO (__VA_ARGS__, _CHECK_CL_TWO, _CHECK_CL_ONE) (__VA_ARGS__)
 
+/**
+ * @brief Options every kernel is built with.
+ *
+ * Names the complex element types after the vector types holding them.
+ */
+#define KERNEL_BUILD_OPTIONS "-Dcfloat=float2 -Dcdouble=double2"
+
+/**
+ * @brief Complex arithmetic kernel functions.
+ *
+ * Since complex elements are vectors, `+` and `-` act as complex addition and
+ * subtraction, but `*` and `/` act on each component. Defines `cmulf (a, b)`,
+ * `cdivf (a, b)` and `cconjf (a)` on cfloat for the complex product,
+ * quotient and conjugate, and @ref _complex_double_fmt defines `cmuld`,
+ * `cdivd` and `cconjd` on cdouble, enabling cl_khr_fp64. Prepended by @ref
+ * try_compile_kernel to kernels using them.
+ */
+extern const char *_complex_fmt;
+extern const char *_complex_double_fmt; /**< @copydoc _complex_fmt */
+
 /**
  * @brief Attempt to compile an OpenCL kernel and log errors.
  *
+ * Builds with @ref KERNEL_BUILD_OPTIONS. Kernels mentioning `cmulf`, `cdivf`
+ * or `cconjf` get the functions of @ref _complex_fmt, and those mentioning
+ * `cmuld`, `cdivd` or `cconjd` the functions of @ref _complex_double_fmt.
+ *
  * @param src kernel to compile.
  * @param kernel_name name of kernel.
  * @param context cl_context to build program for.
@@ -273,6 +299,18 @@ int set_kernel_args (cl_kernel kernel, int num_args, ...);
   _GETM_THREE (__VA_ARGS__, _SET_KERNEL_ARGS_THREE, _SET_KERNEL_ARGS_TWO,     \
                _SET_KERNEL_ARGS_ONE) (kernel, __VA_ARGS__)
 
+/**
+ * @brief Composes the expression applying an operator to `a` and `b`.
+ *
+ * Operators given by name, like min, are called on both operands, other
+ * operators are placed between them. The caller is responsible for freeing
+ * the string.
+ *
+ * @param op Operator to apply.
+ * @return Pointer to null-terminated string, or NULL on failure.
+ */
+char *get_op_expression (const char *op);
+
 /**
  * @brief Get the time taken by a cl_event in nanoseconds.
  *
@@ -295,6 +333,14 @@ void _log_cl_event_time (cl_event event, const char *expr);
 #define LOG_CL_EVENT_TIME(event) _log_cl_event_time ((event), #event)
 
 typedef char voidchar;
+/**
+ * @brief Complex element types, real part first.
+ *
+ * Kernels see them as float2 and double2, through the build options in @ref
+ * KERNEL_BUILD_OPTIONS.
+ */
+typedef cl_float2 cfloat;
+typedef cl_double2 cdouble; /**< @copydoc cfloat */
 #define _TYPE_LIST                                                            \
   X (voidchar, TYPE_UNKNOWN, host, "%c")                                      \
   X (float, TYPE_FLOAT, floats, "%f")                                         \
@@ -303,7 +349,9 @@ typedef char voidchar;
   X (short, TYPE_SHORT, shorts, "%hd")                                        \
   X (int, TYPE_INT, ints, "%d")                                               \
   X (long, TYPE_LONG, longs, "%ld")                                           \
-  X (bool, TYPE_BOOL, bools, "%d")
+  X (bool, TYPE_BOOL, bools, "%d")                                            \
+  X (cfloat, TYPE_CFLOAT, cfloats, "%f%+fi")                                  \
+  X (cdouble, TYPE_CDOUBLE, cdoubles, "%lf%+lfi")
 
 /**
  * @brief Enum representing @ref array element types.
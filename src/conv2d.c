@@ -0,0 +1,122 @@
+#include "conv2d.h"
+#include "cl_utils.h"
+#include "inner_product.h"
+#include <stdio.h>
+
+/* Format strings:
+** 1. X type
+** 2. X type
+** 3. image width
+** 4. image height
+** 5. filter width
+** 6. filter height
+** 7. out width
+** 8. stride
+** 9. padding
+*/
+const char *_conv2d_load_fmt = RAW (
+    % s load_b (__global const % s * B, const int b1, const int b2, int k,
+                int col) {
+      const int x1 = % d;
+      const int x2 = % d;
+      const int f1 = % d;
+      const int f2 = % d;
+      const int y1 = % d;
+      const int stride = % d;
+      const int padding = % d;
+
+      // Row k of the patch matrix is an element of a filter over the input
+      // channels, and column col an output pixel. Columns past the output
+      // are never written, so only reads outside the image need a guard.
+      int patch = f1 * f2;
+      int channel = k / patch;
+      int offset = k - channel * patch;
+      int fy = offset / f1;
+      int out_y = col / y1;
+      int x = (col - out_y * y1) * stride + offset - fy * f1 - padding;
+      int y = out_y * stride + fy - padding;
+      return (channel < b2 && x >= 0 && x < x1 && y >= 0 && y < x2)
+                 ? B[(channel * x2 + y) * x1 + x]
+                 : 0;
+    });
+
+char *
+get_conv2d_load (const char *xtype, int x1, int x2, int f1, int f2, int y1,
+                 int stride, int padding)
+{
+  int size = snprintf (NULL, 0, _conv2d_load_fmt, xtype, xtype, x1, x2, f1,
+                       f2, y1, stride, padding);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _conv2d_load_fmt, xtype, xtype, x1,
+                        x2, f1, f2, y1, stride, padding);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+conv2d (const char *op1, const char *op2, int stride, int padding, array X,
+        array F, array Y, cl_event *event)
+{
+  if (stride < 1 || padding < 0)
+    {
+      handle_error ("Invalid convolution stride %d or padding %d", stride,
+                    padding);
+      return 0;
+    }
+  // X and Y hold the input and output channels of each image in turn, and F
+  // one filter per pair of them, so their product is the square of images.
+  long pairs = (long)X.dim3 * Y.dim3;
+  int images = 1;
+  while ((long)images * images * F.dim3 < pairs)
+    images++;
+  if ((long)images * images * F.dim3 != pairs || X.dim3 % images
+      || Y.dim3 % images)
+    {
+      handle_error ("Cannot convolve %d channels into %d with %d filters",
+                    X.dim3, Y.dim3, F.dim3);
+      return 0;
+    }
+  int width = (X.dim1 + 2 * padding - F.dim1) / stride + 1;
+  int height = (X.dim2 + 2 * padding - F.dim2) / stride + 1;
+  if (Y.dim1 != width || Y.dim2 != height)
+    {
+      handle_error ("Convolution output of %dx%d, expected %dx%d", Y.dim1,
+                    Y.dim2, width, height);
+      return 0;
+    }
+
+  // Filters are the rows of A and output pixels the columns of C, over the
+  // patch matrix of each image, whose elements are gathered from X.
+  int channels = X.dim3 / images;
+  array A = F;
+  A.dim1 = F.dim1 * F.dim2 * channels;
+  A.dim2 = Y.dim3 / images;
+  A.dim3 = 1;
+  array B = X;
+  B.dim1 = X.dim1 * X.dim2;
+  B.dim2 = channels;
+  B.dim3 = images;
+  array C = Y;
+  C.dim1 = Y.dim1 * Y.dim2;
+  C.dim2 = Y.dim3 / images;
+  C.dim3 = images;
+
+  char *load_b
+      = get_conv2d_load (TYPE_STR_FROM_ENUM (X.type), X.dim1, X.dim2, F.dim1,
+                         F.dim2, Y.dim1, stride, padding);
+  unsigned long long time
+      = inner_product_loader (op1, op2, 0, A, B, NULL, C, load_b, event);
+  free (load_b);
+
+  return time;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file conv2d.h
+ */
+
+#ifndef CONV2D_H_
+#define CONV2D_H_
+
+#include "cl_utils.h"
+
+extern const char *_conv2d_load_fmt;
+/**
+ * @brief Composes patch loader of 2D convolution kernels.
+ *
+ * Constructs the kernel function with the specified type and shapes, return
+ * an allocated null-terminated string containing the function.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Defines the `load_b` of @ref get_inner_product_load over the patch matrix
+ * of an image held in B, whose rows are the elements of a filter over the
+ * input channels and whose columns are the output pixels. Each element is
+ * read from the image, or is 0 in the padding, so patches are gathered
+ * straight into the tiles of an inner product rather than unpacked into a
+ * separate buffer.
+ *
+ * @param xtype String for type of the image.
+ * @param x1 Width of the image.
+ * @param x2 Height of the image.
+ * @param f1 Width of the filters.
+ * @param f2 Height of the filters.
+ * @param y1 Width of the output.
+ * @param stride Step between consecutive filter positions.
+ * @param padding Zeros added to each side of the image.
+ * @return Pointer to null-terminated string.
+ */
+char *get_conv2d_load (const char *xtype, int x1, int x2, int f1, int f2,
+                       int y1, int stride, int padding);
+/**
+ * @brief Perform 2D convolution operation.
+ *
+ * Convolves the image X of shape (width, height, in channels) with the filters
+ * F of shape (filter width, filter height, in channels * out channels), laid
+ * out one filter after another, writing into Y of shape (out width,
+ * out height, out channels). The image is padded with zeros on every side,
+ * and filters are moved the given stride at a time, so out width is
+ * `(width + 2 * padding - filter width) / stride + 1`, and likewise for out
+ * height. As is usual for neural networks filters are not flipped, so this is
+ * strictly a cross-correlation. Images stacked along the third dimension of X
+ * and Y are convolved with the same filters.
+ *
+ * Computed by @ref inner_product_loader as the product of the filters with
+ * the patches of X, gathered by @ref get_conv2d_load, so op1 and op2 may be
+ * any semiring as for @ref inner_product, and `+` and `*` on large enough
+ * outputs take the @ref gemm kernel. Blocks and attempts to record timing if
+ * no cl_event is provided, non blocking otherwise.
+ *
+ * @param op1 String of reducing operation to perform.
+ * @param op2 String of pairwise operation to perform.
+ * @param stride Step between consecutive filter positions.
+ * @param padding Zeros added to each side of the image.
+ * @param X @ref array of the input images.
+ * @param F @ref array of the filters.
+ * @param Y @ref array to write the output images into.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // 16 3x3 filters over an RGB image, keeping its size
+ * array F = ALLOC_ARRAY (float, CL_MEM_READ_ONLY, 3, 3, 3 * 16);
+ * array Y = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, X.dim1, X.dim2, 16);
+ * CONV2D("+", "*", 1, 1, X, F, Y);
+ * // The same filters over a batch of 8 images
+ * array Ys = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, X.dim1, X.dim2, 8 * 16);
+ * CONV2D("+", "*", 1, 1, Xs, F, Ys);
+ * // Grayscale dilation by a 3x3 structuring element
+ * CONV2D("max", "+", 1, 1, G, S, D);
+ * // Halve the size with 2x2 filters at stride 2
+ * cl_event event;
+ * CONV2D("+", "*", 2, 0, X, F2, Y2, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long conv2d (const char *op1, const char *op2, int stride,
+                           int padding, array X, array F, array Y,
+                           cl_event *event);
+#define _CONV2D_ONE(op1, op2, stride, padding, X, F, Y)                       \
+  conv2d (op1, op2, stride, padding, X, F, Y, NULL);
+#define _CONV2D_TWO(op1, op2, stride, padding, X, F, Y, event)                \
+  conv2d (op1, op2, stride, padding, X, F, Y, event)
+#define CONV2D(...)                                                           \
+  _GETM_EIGHT (__VA_ARGS__, _CONV2D_TWO,                                      \
+               _CONV2D_ONE) (__VA_ARGS__) /**< @copydoc conv2d*/
+
+#endif // CONV2D_H_
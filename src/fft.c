@@ -0,0 +1,531 @@
+#include "fft.h"
+#include "cl_utils.h"
+#include "transpose.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+** Largest radix of a stage. Radices 2 and 4 have butterflies written out,
+** the others sum their DFT directly.
+*/
+#define FFT_MAX_RADIX 7
+#define FFT_MAX_STAGES 32
+
+/* Format strings:
+** 1. real type
+** 2. complex type
+** 3. tau
+** 4. complex multiplication
+** 5. max radix
+*/
+const char *_fft_butterfly_fmt = RAW (
+    typedef % s real_t;
+    typedef % s complex_t;
+
+    complex_t cmake (real_t re, real_t im) {
+      complex_t c;
+      c.x = re;
+      c.y = im;
+      return c;
+    }
+
+    complex_t croot (real_t sign, int k, int n) {
+      real_t angle = sign * % s * k / n;
+      return cmake (cos (angle), sin (angle));
+    }
+
+    complex_t twiddle (complex_t v, real_t sign, int k, int n) {
+      return % s (v, croot (sign, k, n));
+    }
+
+    void butterfly (complex_t * v, int radix, real_t sign) {
+      if (radix == 2)
+        {
+          complex_t t = v[1];
+          v[1] = v[0] - t;
+          v[0] = v[0] + t;
+        }
+      else if (radix == 4)
+        {
+          complex_t a = v[0] + v[2];
+          complex_t b = v[0] - v[2];
+          complex_t c = v[1] + v[3];
+          complex_t d = v[1] - v[3];
+          complex_t e = cmake (-sign * d.y, sign * d.x);
+          v[0] = a + c;
+          v[1] = b + e;
+          v[2] = a - c;
+          v[3] = b - e;
+        }
+      else
+        {
+          complex_t t[% d];
+          for (int k = 0; k < radix; k++)
+            {
+              t[k] = v[0];
+              for (int r = 1; r < radix; r++)
+                {
+                  int rk = r * k - (r * k / radix) * radix;
+                  t[k] = t[k] + twiddle (v[r], sign, rk, radix);
+                }
+            }
+          for (int k = 0; k < radix; k++)
+            {
+              v[k] = t[k];
+            }
+        }
+    });
+
+/* Format strings:
+** 1. butterfly
+** 2. A type
+** 3. load expression
+** 4. A type
+** 5. B type
+** 6. length
+** 7. stages
+** 8. radices
+** 9. inverse
+** 10. max radix
+*/
+const char *_fft_fmt = RAW (
+    % s
+
+    complex_t load (__global const % s * A, int i) { return % s; }
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int b1, const int b2, const int b3, __global % s * B) {
+      int row = get_group_id (0);
+      int local_id = get_local_id (0);
+      int local_size = get_local_size (0);
+      const int n = % d;
+      const int stages = % d;
+      const int radices[] = { % s };
+      const int inverse = % d;
+      const real_t sign = inverse ? 1 : -1;
+      __local complex_t buffer[2][n];
+
+      A += row * n;
+      B += row * n;
+      for (int i = local_id; i < n; i += local_size)
+        {
+          buffer[0][i] = load (A, i);
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      // Stockham stages read and write whole rows in natural order, so the
+      // result needs no bit reversal.
+      int src = 0;
+      int span = 1;
+      for (int s = 0; s < stages; s++)
+        {
+          int radix = radices[s];
+          int count = n / radix;
+          for (int j = local_id; j < count; j += local_size)
+            {
+              complex_t v[% d];
+              int k = j - (j / span) * span;
+              for (int r = 0; r < radix; r++)
+                {
+                  v[r] = twiddle (buffer[src][j + r * count], sign, r * k,
+                                  span * radix);
+                }
+              butterfly (v, radix, sign);
+              int d = (j - k) * radix + k;
+              for (int r = 0; r < radix; r++)
+                {
+                  buffer[1 - src][d + r * span] = v[r];
+                }
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+          src = 1 - src;
+          span *= radix;
+        }
+
+      real_t scale = inverse ? (real_t)1 / n : 1;
+      for (int i = local_id; i < n; i += local_size)
+        {
+          B[i] = buffer[src][i] * scale;
+        }
+    });
+
+/* Format strings:
+** 1. butterfly
+** 2. A type
+** 3. load expression
+** 4. A type
+** 5. B type
+** 6. inverse
+** 7. max radix
+*/
+const char *_fft_stage_fmt = RAW (
+    % s
+
+    complex_t load (__global const % s * A, int i) { return % s; }
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int b1, const int b2, const int b3, __global % s * B,
+        const int radix, const int span, const real_t scale) {
+      int j = get_global_id (0);
+      int row = get_global_id (1);
+      const int inverse = % d;
+      const real_t sign = inverse ? 1 : -1;
+      int count = b1 / radix;
+
+      if (j < count)
+        {
+          A += row * b1;
+          B += row * b1;
+
+          complex_t v[% d];
+          int k = j - (j / span) * span;
+          for (int r = 0; r < radix; r++)
+            {
+              v[r] = twiddle (load (A, j + r * count), sign, r * k,
+                              span * radix);
+            }
+          butterfly (v, radix, sign);
+          int d = (j - k) * radix + k;
+          for (int r = 0; r < radix; r++)
+            {
+              B[d + r * span] = v[r] * scale;
+            }
+        }
+    });
+
+static char *
+get_fft_butterfly (const char *btype)
+{
+  int is_double = strcmp (btype, "cdouble") == 0;
+  const char *rtype = is_double ? "double" : "float";
+  const char *tau = is_double ? "6.283185307179586" : "6.2831853f";
+  const char *mul = is_double ? "cmuld" : "cmulf";
+  int size = snprintf (NULL, 0, _fft_butterfly_fmt, rtype, btype, tau, mul,
+                       FFT_MAX_RADIX);
+
+  char *butterfly = malloc (size + 1);
+  if (!butterfly)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (butterfly, size + 1, _fft_butterfly_fmt, rtype, btype,
+                        tau, mul, FFT_MAX_RADIX);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return butterfly;
+}
+
+/*
+** Real inputs are loaded with no imaginary part.
+*/
+static const char *
+get_fft_load (const char *atype, const char *btype)
+{
+  return strcmp (atype, btype) == 0 ? "A[i]" : "cmake (A[i], 0)";
+}
+
+char *
+get_fft (const char *atype, const char *btype, int n, const int *radices,
+         int stages, int inverse)
+{
+  char list[4 * FFT_MAX_STAGES] = "1";
+  for (int s = 0, used = 0; s < stages; s++)
+    {
+      used += snprintf (list + used, sizeof (list) - used, s ? ", %d" : "%d",
+                        radices[s]);
+    }
+
+  char *butterfly = get_fft_butterfly (btype);
+  const char *load = get_fft_load (atype, btype);
+  int size = snprintf (NULL, 0, _fft_fmt, butterfly, atype, load, atype,
+                       btype, n, stages, list, inverse, FFT_MAX_RADIX);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _fft_fmt, butterfly, atype, load,
+                        atype, btype, n, stages, list, inverse, FFT_MAX_RADIX);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (butterfly);
+
+  return kernel;
+}
+
+char *
+get_fft_stage (const char *atype, const char *btype, int inverse)
+{
+  char *butterfly = get_fft_butterfly (btype);
+  const char *load = get_fft_load (atype, btype);
+  int size = snprintf (NULL, 0, _fft_stage_fmt, butterfly, atype, load, atype,
+                       btype, inverse, FFT_MAX_RADIX);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _fft_stage_fmt, butterfly, atype,
+                        load, atype, btype, inverse, FFT_MAX_RADIX);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (butterfly);
+
+  return kernel;
+}
+
+/*
+** Splits the length into radices, fours first to halve the stages of powers
+** of two. Returns the number of stages, or -1 if a prime factor is too large.
+*/
+static int
+get_fft_radices (int n, int *radices)
+{
+  static const int candidates[] = { 4, 2, 3, 5, 7 };
+  int stages = 0;
+  for (int c = 0; c < 5; c++)
+    {
+      while (n % candidates[c] == 0)
+        {
+          radices[stages++] = candidates[c];
+          n /= candidates[c];
+        }
+    }
+
+  return n == 1 ? stages : -1;
+}
+
+/*
+** Rows too long for local memory take a launch per stage, alternating
+** between B and a scratch array so the last stage lands in B. A is only read
+** by the first stage, so when it is B and that stage would write B it is
+** first copied to the scratch array.
+*/
+static int
+fft_global (int inverse, array A, array B, const int *radices, int stages,
+            cl_event *partials)
+{
+  int event_count = 0;
+  int n = B.dim1;
+  int rows = B.dim2 * B.dim3;
+  array S = alloc_array (B.type, CL_MEM_READ_WRITE, B.dim1, B.dim2, B.dim3);
+  array src = A;
+  if (A.device == B.device && (stages & 1))
+    {
+      CHECK_CL (clEnqueueCopyBuffer (_queue, A.device, S.device, 0, 0,
+                                     ARRAY_SIZE (A) * A.membsize, 0, NULL,
+                                     &partials[event_count++]));
+      src = S;
+    }
+
+  const char *btype = TYPE_STR_FROM_ENUM (B.type);
+  char *src_first = get_fft_stage (TYPE_STR_FROM_ENUM (src.type), btype,
+                                   inverse);
+  cl_kernel kernel_first = TRY_COMPILE_KERNEL (src_first);
+  free (src_first);
+  cl_kernel kernel = kernel_first;
+  if (src.type != B.type)
+    {
+      char *src_stage = get_fft_stage (btype, btype, inverse);
+      kernel = TRY_COMPILE_KERNEL (src_stage);
+      free (src_stage);
+    }
+
+  int span = 1;
+  for (int s = 0; s < stages; s++)
+    {
+      array dst = ((stages - 1 - s) & 1) ? S : B;
+      cl_kernel k = s ? kernel : kernel_first;
+      int idx = SET_KERNEL_ARGS (k, src, dst);
+      CHECK_CL (clSetKernelArg (k, idx++, sizeof (int), &radices[s]));
+      CHECK_CL (clSetKernelArg (k, idx++, sizeof (int), &span));
+      double scale = (inverse && s == stages - 1) ? 1.0 / n : 1.0;
+      if (B.type == TYPE_CDOUBLE)
+        {
+          CHECK_CL (clSetKernelArg (k, idx++, sizeof (double), &scale));
+        }
+      else
+        {
+          float fscale = scale;
+          CHECK_CL (clSetKernelArg (k, idx++, sizeof (float), &fscale));
+        }
+
+      size_t local_size[] = { _tile_size * _tile_size, 1 };
+      size_t count = n / radices[s];
+      size_t global_size[]
+          = { (count + local_size[0] - 1) / local_size[0] * local_size[0],
+              rows };
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, k, 2, NULL, global_size,
+                                        local_size, 0, NULL,
+                                        &partials[event_count++]));
+      src = dst;
+      span *= radices[s];
+    }
+
+  FREE_ARRAY (S);
+
+  return event_count;
+}
+
+/*
+** Shared by fft and fft_2d, which must reject their arguments before queueing
+** anything. Returns whether A can be transformed into B.
+*/
+static int
+fft_valid (array A, array B)
+{
+  if (B.type != TYPE_CFLOAT && B.type != TYPE_CDOUBLE)
+    {
+      handle_error ("FFT output must be an array of cfloat or cdouble");
+      return 0;
+    }
+  array_type rtype = B.type == TYPE_CFLOAT ? TYPE_FLOAT : TYPE_DOUBLE;
+  if (A.type != B.type && A.type != rtype)
+    {
+      handle_error ("Cannot transform array of %s into array of %s",
+                    TYPE_STR_FROM_ENUM (A.type), TYPE_STR_FROM_ENUM (B.type));
+      return 0;
+    }
+  if (A.dim1 != B.dim1 || A.dim2 != B.dim2 || A.dim3 != B.dim3)
+    {
+      handle_error ("Cannot transform %dx%dx%d array into %dx%dx%d array",
+                    A.dim1, A.dim2, A.dim3, B.dim1, B.dim2, B.dim3);
+      return 0;
+    }
+
+  return 1;
+}
+
+/*
+** As get_fft_radices, reporting lengths it cannot split.
+*/
+static int
+get_fft_stages (int n, int *radices)
+{
+  int stages = get_fft_radices (n, radices);
+  if (stages < 0)
+    {
+      handle_error ("FFT length %d has a prime factor larger than %d", n,
+                    FFT_MAX_RADIX);
+    }
+
+  return stages;
+}
+
+unsigned long long
+fft (int inverse, array A, array B, cl_event *event)
+{
+  if (!fft_valid (A, B))
+    return 0;
+
+  int n = A.dim1;
+  int radices[FFT_MAX_STAGES];
+  int stages = get_fft_stages (n, radices);
+  if (stages < 0)
+    return 0;
+
+  cl_event partials[FFT_MAX_STAGES + 1];
+  int event_count = 0;
+  if (n > FFT_MAX_LOCAL_LENGTH)
+    {
+      event_count = fft_global (inverse, A, B, radices, stages, partials);
+    }
+  else
+    {
+      char *src = get_fft (TYPE_STR_FROM_ENUM (A.type),
+                           TYPE_STR_FROM_ENUM (B.type), n, radices, stages,
+                           inverse);
+      cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+      free (src);
+      SET_KERNEL_ARGS (kernel, A, B);
+
+      // Enough work items for every butterfly of a radix 2 stage.
+      int local = 1;
+      while (2 * local <= n / 2 && 2 * local <= _tile_size * _tile_size)
+        local *= 2;
+      size_t local_size[] = { local };
+      size_t global_size[] = { (size_t)A.dim2 * A.dim3 * local };
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+                                        local_size, 0, NULL,
+                                        &partials[event_count++]));
+    }
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
+
+unsigned long long
+fft_2d (int inverse, array A, array B, cl_event *event)
+{
+  int radices[FFT_MAX_STAGES];
+  if (!fft_valid (A, B) || get_fft_stages (B.dim1, radices) < 0
+      || get_fft_stages (B.dim2, radices) < 0)
+    return 0;
+
+  array T = alloc_array (B.type, CL_MEM_READ_WRITE, B.dim2, B.dim1, B.dim3);
+
+  // A step that fails leaves its event unset, and the later ones are skipped.
+  cl_event partials[4] = { NULL };
+  int event_count = 0;
+  fft (inverse, A, B, &partials[event_count]);
+  if (partials[event_count])
+    transpose (B, T, &partials[++event_count]);
+  if (partials[event_count])
+    fft (inverse, T, T, &partials[++event_count]);
+  if (partials[event_count])
+    transpose (T, B, &partials[++event_count]);
+  if (partials[event_count])
+    event_count++;
+
+  FREE_ARRAY (T);
+
+  if (event_count < 4)
+    return 0;
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
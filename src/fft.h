@@ -0,0 +1,142 @@
+/**
+ * @file fft.h
+ */
+
+#ifndef FFT_H_
+#define FFT_H_
+
+#include "cl_utils.h"
+
+/**
+ * @brief Longest rows transformed in local memory, can be overriden.
+ *
+ * Rows up to this many elements are transformed by a single work group
+ * holding two copies of the row in local memory. Longer rows take a kernel
+ * launch per stage through global memory.
+ */
+#ifndef FFT_MAX_LOCAL_LENGTH
+#define FFT_MAX_LOCAL_LENGTH 1024
+#endif
+
+extern const char *_fft_butterfly_fmt;
+extern const char *_fft_fmt;
+extern const char *_fft_stage_fmt;
+/**
+ * @brief Composes FFT kernel for rows held in local memory.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Each work group loads a row of A into local memory, runs a Stockham stage
+ * for each radix, and writes the transformed row into B. Real elements of A
+ * are taken as complex numbers with no imaginary part.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param btype String for complex type of second @ref array of kernel: B.
+ * @param n Length of the rows.
+ * @param radices Radices of the stages, each 2, 3, 4, 5 or 7.
+ * @param stages Number of stages.
+ * @param inverse Whether to compute the inverse transform.
+ * @return Pointer to null-terminated string.
+ */
+char *get_fft (const char *atype, const char *btype, int n,
+               const int *radices, int stages, int inverse);
+/**
+ * @brief Composes FFT stage kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Runs the Stockham stage given by the radix and span arguments on every row
+ * of A, writing into B scaled by the scale argument.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param btype String for complex type of second @ref array of kernel: B.
+ * @param inverse Whether to compute the inverse transform.
+ * @return Pointer to null-terminated string.
+ */
+char *get_fft_stage (const char *atype, const char *btype, int inverse);
+/**
+ * @brief Perform fast Fourier transform.
+ *
+ * Writes into B the discrete Fourier transform of each row of A, or the
+ * inverse transform scaled by the length of the rows, so that the inverse
+ * of the transform is the original row. B must be an @ref array of cfloat or
+ * cdouble with the dimensions of A, and A either of the same type or of the
+ * matching real type. Rows may have any length whose prime factors are 2, 3,
+ * 5 and 7. B may be A. Blocks and attempts to record timing if no cl_event
+ * is provided, non blocking otherwise.
+ *
+ * Complex elements are float2 or double2 vectors in kernels, so `*` and `/`
+ * between two of them act on each component. Spectra are multiplied and
+ * divided with the `cmulf` and `cdivf` of @ref _complex_fmt instead, or
+ * their cdouble counterparts.
+ *
+ * @param inverse Whether to compute the inverse transform.
+ * @param A @ref array to transform.
+ * @param B @ref array to write the transform into.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Filter a batch of signals by a float row of gains per frequency
+ * array F = ALLOC_ARRAY (cfloat, CL_MEM_READ_WRITE, signals.dim1,
+ *                        signals.dim2);
+ * FFT(signals, F);
+ * MAP("a * b", gains, F);
+ * IFFT(F, F);
+ * // Circular convolution with a cfloat spectrum K of a kernel
+ * FFT(signals, F);
+ * MAP("cmulf (a, b)", K, F);
+ * IFFT(F, F);
+ * @endcode
+ */
+unsigned long long fft (int inverse, array A, array B, cl_event *event);
+#define _FFT_ONE(A, B) fft (0, A, B, NULL);
+#define _FFT_TWO(A, B, event) fft (0, A, B, event)
+#define FFT(...)                                                              \
+  _GETM_THREE (__VA_ARGS__, _FFT_TWO, _FFT_ONE) (                             \
+      __VA_ARGS__) /**< @copydoc fft*/
+#define _IFFT_ONE(A, B) fft (1, A, B, NULL);
+#define _IFFT_TWO(A, B, event) fft (1, A, B, event)
+#define IFFT(...)                                                             \
+  _GETM_THREE (__VA_ARGS__, _IFFT_TWO, _IFFT_ONE) (                           \
+      __VA_ARGS__) /**< @copydoc fft*/
+/**
+ * @brief Perform two dimensional fast Fourier transform.
+ *
+ * Same as @ref fft, transforming each matrix of A along both of its first
+ * two dimensions, whose lengths must both factor into 2, 3, 5 and 7. Rows
+ * are transformed, transposed, transformed again as rows and transposed back,
+ * so every pass reads contiguous memory.
+ *
+ * @param inverse Whether to compute the inverse transform.
+ * @param A @ref array to transform.
+ * @param B @ref array to write the transform into.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * array F = ALLOC_ARRAY (cfloat, CL_MEM_READ_WRITE, image.dim1, image.dim2);
+ * FFT_2D(image, F);
+ * @endcode
+ */
+unsigned long long fft_2d (int inverse, array A, array B, cl_event *event);
+#define _FFT_2D_ONE(A, B) fft_2d (0, A, B, NULL);
+#define _FFT_2D_TWO(A, B, event) fft_2d (0, A, B, event)
+#define FFT_2D(...)                                                           \
+  _GETM_THREE (__VA_ARGS__, _FFT_2D_TWO, _FFT_2D_ONE) (                       \
+      __VA_ARGS__) /**< @copydoc fft_2d*/
+#define _IFFT_2D_ONE(A, B) fft_2d (1, A, B, NULL);
+#define _IFFT_2D_TWO(A, B, event) fft_2d (1, A, B, event)
+#define IFFT_2D(...)                                                          \
+  _GETM_THREE (__VA_ARGS__, _IFFT_2D_TWO, _IFFT_2D_ONE) (                     \
+      __VA_ARGS__) /**< @copydoc fft_2d*/
+
+#endif // FFT_H_
@@ -0,0 +1,268 @@
+#include "fill.h"
+#include "cl_utils.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Format strings:
+** 1. A type
+** 2. value type
+** 3. value type
+** 4. value type
+** 5. value type
+** 6. element expression
+*/
+const char *_iota_fmt = RAW (
+    __kernel void entry (const int a1, const int a2, const int a3,
+                         __global % s * A, const % s start, const % s step,
+                         const % s last) {
+      int i = get_global_id (0);
+      int total = a1 * a2 * a3;
+      if (i < total)
+        {
+          % s x = i == total - 1 ? last : start + i * step;
+          A[i] = % s;
+        }
+    });
+
+/* Format strings:
+** 1. A type
+** 2. one expression
+*/
+const char *_eye_fmt = RAW (
+    __kernel void entry (const int a1, const int a2, const int a3,
+                         __global % s * A) {
+      int d = get_global_id (0);
+      int m = get_global_id (1);
+      if (d < min (a1, a2))
+        {
+          A[(m * a2 + d) * a1 + d] = % s;
+        }
+    });
+
+/*
+** Complex elements take real values as their real part, written as a vector
+** literal since the element type names are only defined at build time.
+*/
+static const char *
+get_element_expression (const char *atype, const char *x)
+{
+  if (strcmp (atype, "cfloat") == 0)
+    {
+      return strcmp (x, "x") == 0 ? "(float2)(x, 0)" : "(float2)(1, 0)";
+    }
+  if (strcmp (atype, "cdouble") == 0)
+    {
+      return strcmp (x, "x") == 0 ? "(double2)(x, 0)" : "(double2)(1, 0)";
+    }
+  return x;
+}
+
+char *
+get_iota (const char *atype, const char *vtype)
+{
+  const char *expression = get_element_expression (atype, "x");
+
+  int size = snprintf (NULL, 0, _iota_fmt, atype, vtype, vtype, vtype, vtype,
+                       expression);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _iota_fmt, atype, vtype, vtype,
+                        vtype, vtype, expression);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+char *
+get_eye (const char *atype)
+{
+  const char *one = get_element_expression (atype, "1");
+
+  int size = snprintf (NULL, 0, _eye_fmt, atype, one);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _eye_fmt, atype, one);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+fill (array A, double value, cl_event *event)
+{
+  char pattern[sizeof (cdouble)] = { 0 };
+  switch (A.type)
+    {
+    case TYPE_FLOAT:
+    case TYPE_CFLOAT:
+      *(float *)pattern = value;
+      break;
+    case TYPE_DOUBLE:
+    case TYPE_CDOUBLE:
+      *(double *)pattern = value;
+      break;
+    case TYPE_CHAR:
+      *(char *)pattern = value;
+      break;
+    case TYPE_SHORT:
+      *(short *)pattern = value;
+      break;
+    case TYPE_INT:
+      *(int *)pattern = value;
+      break;
+    case TYPE_LONG:
+      *(long *)pattern = value;
+      break;
+    case TYPE_BOOL:
+      *(bool *)pattern = value != 0;
+      break;
+    default:
+      handle_error ("Cannot fill array of unknown type");
+      return 0;
+    }
+
+  cl_event partial;
+  CHECK_CL (clEnqueueFillBuffer (_queue, A.device, pattern, A.membsize, 0,
+                                 ARRAY_SIZE (A) * A.membsize, 0, NULL,
+                                 &partial));
+
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (clEnqueueMarkerWithWaitList (_queue, 1, &partial, event));
+      return 0;
+    }
+
+  return GET_CL_EVENT_TIME (partial);
+}
+
+/*
+** Shared by iota and linspace, which only differ in the type the sequence is
+** computed in and how its step is found.
+*/
+static unsigned long long
+sequence (array A, int integral, double start, double step, double last,
+          cl_event *event)
+{
+  int wide = A.type == TYPE_DOUBLE || A.type == TYPE_CDOUBLE
+             || A.type == TYPE_LONG;
+  const char *vtype = integral ? "long" : wide ? "double" : "float";
+  char *src = get_iota (TYPE_STR_FROM_ENUM (A.type), vtype);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  int idx = SET_KERNEL_ARGS (kernel, A);
+  if (integral)
+    {
+      long values[] = { start, step, last };
+      for (int i = 0; i < 3; i++)
+        CHECK_CL (
+            clSetKernelArg (kernel, idx++, sizeof (long), &values[i]));
+    }
+  else if (wide)
+    {
+      double values[] = { start, step, last };
+      for (int i = 0; i < 3; i++)
+        CHECK_CL (
+            clSetKernelArg (kernel, idx++, sizeof (double), &values[i]));
+    }
+  else
+    {
+      float values[] = { start, step, last };
+      for (int i = 0; i < 3; i++)
+        CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (float), &values[i]));
+    }
+
+  cl_event partial;
+  size_t local_size[] = { _tile_size };
+  size_t global_size[] = { LOWEST_MULTIPLE_OF_TILE (ARRAY_SIZE (A)) };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+                                    local_size, 0, NULL, &partial));
+
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (clEnqueueMarkerWithWaitList (_queue, 1, &partial, event));
+      return 0;
+    }
+
+  return GET_CL_EVENT_TIME (partial);
+}
+
+unsigned long long
+iota (array A, double start, double step, cl_event *event)
+{
+  int integral = A.type == TYPE_CHAR || A.type == TYPE_SHORT
+                 || A.type == TYPE_INT || A.type == TYPE_LONG
+                 || A.type == TYPE_BOOL;
+  return sequence (A, integral, start, step,
+                   start + (ARRAY_SIZE (A) - 1) * step, event);
+}
+
+unsigned long long
+linspace (array A, double start, double stop, cl_event *event)
+{
+  int n = ARRAY_SIZE (A);
+  double step = n > 1 ? (stop - start) / (n - 1) : 0;
+  return sequence (A, 0, start, step, n > 1 ? stop : start, event);
+}
+
+unsigned long long
+eye (array A, cl_event *event)
+{
+  char *src = get_eye (TYPE_STR_FROM_ENUM (A.type));
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  SET_KERNEL_ARGS (kernel, A);
+
+  cl_event partials[2];
+  int event_count = 0;
+  char zero[sizeof (cdouble)] = { 0 };
+  CHECK_CL (clEnqueueFillBuffer (_queue, A.device, zero, A.membsize, 0,
+                                 ARRAY_SIZE (A) * A.membsize, 0, NULL,
+                                 &partials[event_count++]));
+
+  size_t diagonal = A.dim1 < A.dim2 ? A.dim1 : A.dim2;
+  size_t local_size[] = { _tile_size, 1 };
+  size_t global_size[] = { LOWEST_MULTIPLE_OF_TILE (diagonal), A.dim3 };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 2, NULL, global_size,
+                                    local_size, 1, partials,
+                                    &partials[event_count++]));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
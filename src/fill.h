@@ -0,0 +1,151 @@
+/**
+ * @file fill.h
+ */
+
+#ifndef FILL_H_
+#define FILL_H_
+
+#include "cl_utils.h"
+
+extern const char *_iota_fmt;
+extern const char *_eye_fmt;
+/**
+ * @brief Composes arithmetic sequence kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Writes into each element i of A the start argument plus i times the step
+ * argument, computed in vtype, except for the last element which gets the
+ * last argument exactly.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param vtype String for type the sequence is computed in.
+ * @return Pointer to null-terminated string.
+ */
+char *get_iota (const char *atype, const char *vtype);
+/**
+ * @brief Composes identity diagonal kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Writes one into the diagonal of each matrix of A, leaving the other
+ * elements untouched.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @return Pointer to null-terminated string.
+ */
+char *get_eye (const char *atype);
+/**
+ * @brief Fill an @ref array with a value.
+ *
+ * Sets every element of A to value, converted to the element type, on the
+ * device with clEnqueueFillBuffer, so nothing is transferred from the host.
+ * Complex elements get value as their real part. Blocks and attempts to
+ * record timing if no cl_event is provided, non blocking otherwise.
+ *
+ * @param A @ref array to fill.
+ * @param value Value of every element.
+ * @param event cl_event to be attached to the fill.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * array C = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, 1024, 1024);
+ * FILL(C, 0);
+ * @endcode
+ */
+unsigned long long fill (array A, double value, cl_event *event);
+#define _FILL_ONE(A, value) fill (A, value, NULL);
+#define _FILL_TWO(A, value, event) fill (A, value, event)
+#define FILL(...)                                                             \
+  _GETM_THREE (__VA_ARGS__, _FILL_TWO, _FILL_ONE) (                           \
+      __VA_ARGS__) /**< @copydoc fill*/
+/**
+ * @brief Fill an @ref array with an arithmetic sequence.
+ *
+ * Sets element i of A, in memory order, to start + i * step. The sequence is
+ * computed in long for integer elements, and in the floating point type of
+ * the elements otherwise. Complex elements get it as their real part. Blocks
+ * and attempts to record timing if no cl_event is provided, non blocking
+ * otherwise.
+ *
+ * @param A @ref array to fill.
+ * @param start Value of the first element.
+ * @param step Difference between consecutive elements.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // 0, 1, 2, ...
+ * IOTA(I, 0, 1);
+ * // 1, 3, 5, ...
+ * IOTA(odd, 1, 2);
+ * @endcode
+ */
+unsigned long long iota (array A, double start, double step, cl_event *event);
+#define _IOTA_ONE(A, start, step) iota (A, start, step, NULL);
+#define _IOTA_TWO(A, start, step, event) iota (A, start, step, event)
+#define IOTA(...)                                                             \
+  _GETM_FOUR (__VA_ARGS__, _IOTA_TWO, _IOTA_ONE) (                            \
+      __VA_ARGS__) /**< @copydoc iota*/
+#define ARANGE(...) IOTA (__VA_ARGS__) /**< @copydoc iota*/
+/**
+ * @brief Fill an @ref array with evenly spaced values.
+ *
+ * Sets the elements of A, in memory order, to values evenly spaced from
+ * start to stop, both included. A single element gets start. Values are
+ * computed in double for double, cdouble and long elements and in float
+ * otherwise, then converted as by a cast. Blocks and attempts to record
+ * timing if no cl_event is provided, non blocking otherwise.
+ *
+ * @param A @ref array to fill.
+ * @param start Value of the first element.
+ * @param stop Value of the last element.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * array X = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, 101);
+ * LINSPACE(X, 0.0, 1.0);
+ * @endcode
+ */
+unsigned long long linspace (array A, double start, double stop,
+                             cl_event *event);
+#define _LINSPACE_ONE(A, start, stop) linspace (A, start, stop, NULL);
+#define _LINSPACE_TWO(A, start, stop, event) linspace (A, start, stop, event)
+#define LINSPACE(...)                                                         \
+  _GETM_FOUR (__VA_ARGS__, _LINSPACE_TWO, _LINSPACE_ONE) (                    \
+      __VA_ARGS__) /**< @copydoc linspace*/
+/**
+ * @brief Fill an @ref array with identity matrices.
+ *
+ * Sets each matrix of A to ones on its diagonal and zeros elsewhere. A need
+ * not be square, the diagonal running from the first element to the end of
+ * the shorter dimension. Blocks and attempts to record timing if no cl_event
+ * is provided, non blocking otherwise.
+ *
+ * @param A @ref array to fill.
+ * @param event cl_event to be attached to the calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * array I = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, n, n);
+ * EYE(I);
+ * @endcode
+ */
+unsigned long long eye (array A, cl_event *event);
+#define _EYE_ONE(A) eye (A, NULL);
+#define _EYE_TWO(A, event) eye (A, event)
+#define EYE(...)                                                              \
+  _GETM_TWO (__VA_ARGS__, _EYE_TWO, _EYE_ONE) (__VA_ARGS__) /**< @copydoc eye*/
+
+#endif // FILL_H_
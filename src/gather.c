@@ -0,0 +1,85 @@
+#include "gather.h"
+#include "cl_utils.h"
+#include <stdio.h>
+
+/* Format strings:
+** 1. A type
+** 2. I type
+** 3. B type
+*/
+const char *_gather_fmt = RAW (__kernel void entry (
+    const int a1, const int a2, const int a3, __global const % s * A,
+    const int i1, const int i2, const int i3, __global const % s * I,
+    const int b1, const int b2, const int b3, __global % s * B) {
+  int global_id = get_global_id (0);
+
+  int count = i1 * i2 * i3;
+  int width = (b1 * b2 * b3) / count;
+  int rows = (a1 * a2 * a3) / width;
+  if (global_id < count * width)
+    {
+      int i = global_id / width;
+      int idx = I[i];
+      if (idx >= 0 && idx < rows)
+        {
+          B[global_id] = A[idx * width + global_id - i * width];
+        }
+    }
+});
+
+char *
+get_gather (const char *atype, const char *itype, const char *btype)
+{
+  int size = snprintf (NULL, 0, _gather_fmt, atype, itype, btype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _gather_fmt, atype, itype, btype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+gather (array A, array I, array B, cl_event *event)
+{
+  cl_event _event;
+  if (ARRAY_SIZE (B) % ARRAY_SIZE (I) != 0
+      || ARRAY_SIZE (A) % (ARRAY_SIZE (B) / ARRAY_SIZE (I)) != 0)
+    {
+      handle_error ("Cannot gather %d indices into %d elements from %d",
+                    ARRAY_SIZE (I), ARRAY_SIZE (B), ARRAY_SIZE (A));
+      return 0;
+    }
+
+  char *src = get_gather (TYPE_STR_FROM_ENUM (A.type),
+                          TYPE_STR_FROM_ENUM (I.type),
+                          TYPE_STR_FROM_ENUM (B.type));
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  SET_KERNEL_ARGS (kernel, A, I, B);
+
+  size_t local_size[] = { _tile_size };
+  size_t global_size[] = { LOWEST_MULTIPLE_OF_TILE (ARRAY_SIZE (B)) };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    event ? event : &_event));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file gather.h
+ */
+
+#ifndef GATHER_H_
+#define GATHER_H_
+
+#include "cl_utils.h"
+
+extern const char *_gather_fmt;
+/**
+ * @brief Composes gather kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the third input argument B, the rows of A indexed by I are written in
+ * order. Rows are as long as B has elements per index in I.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param itype String for type of second @ref array of kernel: I.
+ * @param btype String for type of third @ref array of kernel: B.
+ * @return Pointer to null-terminated string.
+ */
+char *get_gather (const char *atype, const char *itype, const char *btype);
+/**
+ * @brief Perform gather operation.
+ *
+ * Writes `B[i] = A[I[i]]` for every index in I. If B has several elements per
+ * index, A is split into rows of that many elements and whole rows are
+ * gathered, such as looking up the rows of an embedding table. Indices out of
+ * the range of rows of A leave their row of B untouched. Blocks and attempts
+ * to record timing if no cl_event is provided, non blocking otherwise.
+ *
+ * @param A @ref array to read from.
+ * @param I @ref array of integer indices into A.
+ * @param B @ref array to write into.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Apply a permutation
+ * GATHER(A, perm, B);
+ * // Look up embedding rows, table is (dim, vocab) and out is (dim, n)
+ * cl_event event;
+ * GATHER(table, ids, out, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long gather (array A, array I, array B, cl_event *event);
+#define _GATHER_ONE(A, I, B) gather (A, I, B, NULL);
+#define _GATHER_TWO(A, I, B, event) gather (A, I, B, event)
+#define GATHER(...)                                                           \
+  _GETM_FOUR (__VA_ARGS__, _GATHER_TWO,                                       \
+              _GATHER_ONE) (__VA_ARGS__) /**< @copydoc gather*/
+
+#endif // GATHER_H_
@@ -0,0 +1,310 @@
+#include "gemm.h"
+#include "cl_utils.h"
+#include "inner_product.h"
+#include <stdio.h>
+
+/* Format strings:
+** 1. B loader
+** 2. A type
+** 3. B type
+** 4. C type
+** 5. TILE_SIZE
+** 6. GEMM_WORK_PER_THREAD
+** 7. lower
+** 8. upper
+** 9. symmetric
+** 10. a_lower
+** 11. a_upper
+** 12. b_lower
+** 13. b_upper
+** 14. b_matrix
+** 15. A_tile type
+** 16. B_tile type
+** 17. acc type
+** 18. a type
+** 19. b type
+** 20. a_reg type
+** 21. b_reg type
+*/
+const char *_gemm_fmt = RAW (% s __kernel void entry (
+    const int a1, const int a2, const int a3, __global const % s * A,
+    const int b1, const int b2, const int b3, __global const % s * B,
+    const int c1, const int c2, const int c3, __global % s * C) {
+  int local_row = get_local_id (1);
+  int local_col = get_local_id (0);
+  int batch = get_global_id (2);
+  const int tile_size = % d;
+  const int wpt = % d;
+  const int lower = % d;
+  const int upper = % d;
+  const int symmetric = % d;
+  const int a_lower = % d;
+  const int a_upper = % d;
+  const int b_lower = % d;
+  const int b_upper = % d;
+  const int b_matrix = % d;
+
+  // Operands with a single matrix are shared by every batch.
+  A += (a3 > 1) * batch * a1 * a2;
+  B += (b3 > 1) * batch * b1 * b2;
+  C += batch * c1 * c2;
+  const int block = tile_size * wpt;
+  const int stride = block + 1;
+
+  // Blocks of C entirely outside the output triangle are skipped, and
+  // triangular operands bound the inner dimension of the whole block.
+  int row_first = get_group_id (1) * block;
+  int col_first = get_group_id (0) * block;
+  if (((lower || symmetric) && row_first + block - 1 < col_first)
+      || (upper && row_first > col_first + block - 1))
+    {
+      return;
+    }
+  int k_begin = 0;
+  int k_end = a1;
+  if (a_lower)
+    k_end = min (k_end, row_first + block);
+  if (a_upper)
+    k_begin = max (k_begin, row_first);
+  if (b_lower)
+    k_begin = max (k_begin, col_first);
+  if (b_upper)
+    k_end = min (k_end, col_first + block);
+
+  // Tiles are stored k major, padded by one to spread transposed stores of A
+  // across banks, with two buffers each to overlap loads and products.
+  __local % s A_tile[2 * tile_size * stride];
+  __local % s B_tile[2 * tile_size * stride];
+  % s acc[wpt][wpt];
+  for (int i = 0; i < wpt; i++)
+    {
+      for (int j = 0; j < wpt; j++)
+        {
+          acc[i][j] = 0;
+        }
+    }
+
+  // Each work item loads wpt consecutive elements of a row of A and of B.
+  int id = local_row * tile_size + local_col;
+  int load_row = id / (tile_size / wpt);
+  int load_k = (id - load_row * (tile_size / wpt)) * wpt;
+  int load_b_k = id / tile_size;
+  int load_col = (id - load_b_k * tile_size) * wpt;
+  int row_A = row_first + load_row;
+  int col_B = col_first + load_col;
+
+  // Tile t + 1 loads into one buffer while tile t is multiplied from the
+  // other, which the barrier of the previous step has finished reading.
+  // Elements outside triangular operands load as zero.
+  int tiles = (k_end - k_begin + tile_size - 1) / tile_size;
+  for (int t = -1; t < tiles; t++)
+    {
+      if (t + 1 < tiles)
+        {
+          int buf = ((t + 1) & 1) * tile_size * stride;
+          % s a[wpt];
+          % s b[wpt];
+          int k = k_begin + (t + 1) * tile_size + load_k;
+          if (row_A < a2 && k + wpt <= k_end
+              && (!a_lower || k + wpt - 1 <= row_A)
+              && (!a_upper || k >= row_A))
+            {
+              vstore4 (vload4 (0, A + row_A * a1 + k), 0, a);
+            }
+          else
+            {
+              for (int c = 0; c < wpt; c++)
+                {
+                  a[c] = (row_A < a2 && k + c < k_end
+                          && (!a_lower || k + c <= row_A)
+                          && (!a_upper || k + c >= row_A))
+                             ? A[row_A * a1 + k + c]
+                             : 0;
+                }
+            }
+          k = k_begin + (t + 1) * tile_size + load_b_k;
+          if (b_matrix && k < k_end && k < b2 && col_B + wpt <= b1
+              && (!b_lower || k >= col_B + wpt - 1)
+              && (!b_upper || k <= col_B))
+            {
+              vstore4 (vload4 (0, B + k * b1 + col_B), 0, b);
+            }
+          else
+            {
+              for (int c = 0; c < wpt; c++)
+                {
+                  b[c] = (k < k_end && (!b_lower || k >= col_B + c)
+                          && (!b_upper || k <= col_B + c))
+                             ? load_b (B, b1, b2, k, col_B + c)
+                             : 0;
+                }
+            }
+          for (int c = 0; c < wpt; c++)
+            {
+              A_tile[buf + (load_k + c) * stride + load_row] = a[c];
+              B_tile[buf + load_b_k * stride + load_col + c] = b[c];
+            }
+        }
+
+      if (t >= 0)
+        {
+          int buf = (t & 1) * tile_size * stride;
+          for (int k = 0; k < tile_size; k++)
+            {
+              % s a_reg[wpt];
+              % s b_reg[wpt];
+              for (int i = 0; i < wpt; i++)
+                {
+                  a_reg[i] = A_tile[buf + k * stride + local_row
+                                    + i * tile_size];
+                  b_reg[i] = B_tile[buf + k * stride + local_col
+                                    + i * tile_size];
+                }
+              for (int i = 0; i < wpt; i++)
+                {
+                  for (int j = 0; j < wpt; j++)
+                    {
+                      acc[i][j] += a_reg[i] * b_reg[j];
+                    }
+                }
+            }
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+    }
+
+  int row0 = row_first + local_row;
+  int col0 = col_first + local_col;
+  for (int i = 0; i < wpt; i++)
+    {
+      for (int j = 0; j < wpt; j++)
+        {
+          int row = row0 + i * tile_size;
+          int col = col0 + j * tile_size;
+          // As in the inner product kernel, elements no k contributes to
+          // are left untouched.
+          int k_lo = max (a_upper ? row : 0, b_lower ? col : 0);
+          int k_hi = min (a1, min (a_lower ? row + 1 : a1,
+                                   b_upper ? col + 1 : a1));
+          if (row < c2 && col < c1 && (!(lower || symmetric) || row >= col)
+              && (!upper || row <= col) && k_lo < k_hi)
+            {
+              C[row * c1 + col] = acc[i][j];
+              if (symmetric && row != col)
+                {
+                  C[col * c1 + row] = acc[i][j];
+                }
+            }
+        }
+    }
+});
+
+char *
+get_gemm (const char *dtype, int structure, const char *load_b)
+{
+  char *load = load_b ? NULL : get_inner_product_load (dtype);
+  const char *loader = load_b ? load_b : load;
+  int b_matrix = load_b == NULL;
+  int lower = (structure & INNER_PRODUCT_LOWER) != 0;
+  int upper = (structure & INNER_PRODUCT_UPPER) != 0;
+  int symmetric = (structure & INNER_PRODUCT_SYMMETRIC) != 0;
+  int a_lower = (structure & INNER_PRODUCT_A_LOWER) != 0;
+  int a_upper = (structure & INNER_PRODUCT_A_UPPER) != 0;
+  int b_lower = (structure & INNER_PRODUCT_B_LOWER) != 0;
+  int b_upper = (structure & INNER_PRODUCT_B_UPPER) != 0;
+  int size = snprintf (NULL, 0, _gemm_fmt, loader, dtype, dtype, dtype,
+                       _tile_size, GEMM_WORK_PER_THREAD, lower, upper,
+                       symmetric, a_lower, a_upper, b_lower, b_upper, b_matrix,
+                       dtype, dtype, dtype, dtype, dtype, dtype, dtype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _gemm_fmt, loader, dtype, dtype,
+                        dtype, _tile_size, GEMM_WORK_PER_THREAD, lower, upper,
+                        symmetric, a_lower, a_upper, b_lower, b_upper,
+                        b_matrix, dtype, dtype, dtype, dtype, dtype, dtype,
+                        dtype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (load);
+
+  return kernel;
+}
+
+int
+gemm_supported (array A, array B, array C)
+{
+  if (A.type != B.type || A.type != C.type)
+    return 0;
+  if (_tile_size % GEMM_WORK_PER_THREAD != 0)
+    return 0;
+  return A.type == TYPE_FLOAT || A.type == TYPE_DOUBLE || A.type == TYPE_INT
+         || A.type == TYPE_LONG;
+}
+
+unsigned long long
+gemm_loader (int structure, array A, array B, array C, const char *load_b,
+             cl_event *event)
+{
+  cl_event _event;
+  if (!gemm_supported (A, B, C))
+    {
+      handle_error ("Unsupported types or tile size for matrix product");
+      return 0;
+    }
+  if ((A.dim3 != C.dim3 && A.dim3 != 1) || (B.dim3 != C.dim3 && B.dim3 != 1))
+    {
+      handle_error ("Cannot batch %d and %d matrices into %d", A.dim3, B.dim3,
+                    C.dim3);
+      return 0;
+    }
+
+  if ((structure & INNER_PRODUCT_SYMMETRIC) && C.dim1 != C.dim2)
+    {
+      handle_error ("Symmetric product into %dx%d matrix, which is not square",
+                    C.dim1, C.dim2);
+      return 0;
+    }
+
+  char *src = get_gemm (TYPE_STR_FROM_ENUM (C.type), structure, load_b);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  SET_KERNEL_ARGS (kernel, A, B, C);
+
+  int block = _tile_size * GEMM_WORK_PER_THREAD;
+  size_t local_size[] = { _tile_size, _tile_size, 1 };
+  size_t global_size[] = { ((C.dim1 + block - 1) / block) * _tile_size,
+                           ((C.dim2 + block - 1) / block) * _tile_size,
+                           C.dim3 };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    event ? event : &_event));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
+
+unsigned long long
+gemm_structured (int structure, array A, array B, array C, cl_event *event)
+{
+  return gemm_loader (structure, A, B, C, NULL, event);
+}
+
+unsigned long long
+gemm (array A, array B, array C, cl_event *event)
+{
+  return gemm_structured (0, A, B, C, event);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file gemm.h
+ */
+
+#ifndef GEMM_H_
+#define GEMM_H_
+
+#include "cl_utils.h"
+
+/**
+ * @brief Outputs per work item along each dimension, and vector width of
+ * loads.
+ */
+#define GEMM_WORK_PER_THREAD 4
+
+extern const char *_gemm_fmt;
+/**
+ * @brief Composes register blocked matrix multiplication kernel.
+ *
+ * Constructs the kernel with the specified type, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the third input argument C, the matrix product of A and B is written.
+ * Each work group computes a block of GEMM_WORK_PER_THREAD tiles along each
+ * dimension, each work item accumulating GEMM_WORK_PER_THREAD squared outputs
+ * in registers. Tiles of A and B are loaded with vector loads into a pair of
+ * padded local memory buffers, so the next tile loads while the current one
+ * is multiplied. Blocks outside the output triangle and products outside
+ * triangular operands are skipped as given by the structure flags. Elements
+ * of B are read through the load_b function of @ref get_inner_product_load,
+ * with scalar loads unless B is read as a matrix.
+ *
+ * @param dtype String for type of all @ref array "arrays" of kernel.
+ * @param structure Bitwise or of @ref inner_product_structure flags.
+ * @param load_b String defining `load_b`, or NULL to read B as a matrix.
+ * @return Pointer to null-terminated string.
+ */
+char *get_gemm (const char *dtype, int structure, const char *load_b);
+/**
+ * @brief Check whether @ref gemm supports the given arrays.
+ *
+ * @param A First argument @ref array of the kernel.
+ * @param B Second argument @ref array of the kernel.
+ * @param C Third argument @ref array of the kernel.
+ * @return Non zero if A, B and C share a float, double, int or long type and
+ * the tile size is a multiple of GEMM_WORK_PER_THREAD.
+ */
+int gemm_supported (array A, array B, array C);
+/**
+ * @brief Perform matrix multiplication.
+ *
+ * Like @ref inner_product with `+` and `*`, including batches along the third
+ * dimension, which calls this for large enough products whenever
+ * @ref gemm_supported holds. Blocks and attempts to record timing if no
+ * cl_event is provided, non blocking otherwise.
+ *
+ * @param A First argument @ref array of the kernel.
+ * @param B Second argument @ref array of the kernel.
+ * @param C Third argument @ref array of the kernel.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * cl_event event;
+ * GEMM(A, B, C, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long gemm (array A, array B, array C, cl_event *event);
+/**
+ * @brief Perform structured matrix multiplication.
+ *
+ * Like @ref gemm, for the structure flags of
+ * @ref inner_product_structured, which calls this for large enough products
+ * without a block mask. Blocks and attempts to record timing if no cl_event
+ * is provided, non blocking otherwise.
+ *
+ * @param structure Bitwise or of @ref inner_product_structure flags.
+ * @param A First argument @ref array of the kernel.
+ * @param B Second argument @ref array of the kernel.
+ * @param C Third argument @ref array of the kernel.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ */
+unsigned long long gemm_structured (int structure, array A, array B, array C,
+                                    cl_event *event);
+#define _GEMM_ONE(A, B, C) gemm (A, B, C, NULL);
+#define _GEMM_TWO(A, B, C, event) gemm (A, B, C, event)
+#define GEMM(...)                                                             \
+  _GETM_FOUR (__VA_ARGS__, _GEMM_TWO, _GEMM_ONE) (                            \
+      __VA_ARGS__) /**< @copydoc gemm*/
+/**
+ * @brief Perform matrix multiplication with a computed right operand.
+ *
+ * Like @ref gemm_structured, reading the elements of B through load_b as
+ * @ref inner_product_loader does, which calls this for large enough products
+ * with `+` and `*`. Blocks and attempts to record timing if no cl_event is
+ * provided, non blocking otherwise.
+ *
+ * @param structure Bitwise or of @ref inner_product_structure flags.
+ * @param A First argument @ref array of the kernel.
+ * @param B Second argument @ref array of the kernel.
+ * @param C Third argument @ref array of the kernel.
+ * @param load_b String defining `load_b`, or NULL to read B as a matrix.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ */
+unsigned long long gemm_loader (int structure, array A, array B, array C,
+                                const char *load_b, cl_event *event);
+
+#endif // GEMM_H_
@@ -0,0 +1,269 @@
+#include "histogram.h"
+#include "cl_utils.h"
+#include <stdio.h>
+#include <string.h>
+
+#define HISTOGRAM_ITEMS_PER_WORK_ITEM 64
+
+/* Format strings:
+** 1. v type
+** 2. add body
+** 3. v type
+** 4. add body
+** 5. value type
+** 6. value expression
+** 7. A type
+** 8. W type
+** 9. E type
+** 10. lo type
+** 11. hi type
+** 12. bins
+** 13. copies
+** 14. has_weights
+** 15. has_edges
+** 16. edges type
+** 17. scale type
+** 18. x type
+** 19. v type
+** 20. v type
+** 21. v type
+** 22. sum type
+*/
+const char *_histogram_fmt = RAW (
+    void hist_add_local (volatile __local int *p, % s v) { % s }
+
+    void hist_add_global (volatile __global int *p, % s v) { % s }
+
+    % s hist_value (int bits) { return % s; }
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int w1, const int w2, const int w3, __global const % s * W,
+        const int e1, const int e2, const int e3, __global const % s * E,
+        const int h1, const int h2, const int h3, __global int *H,
+        const % s lo, const % s hi) {
+      int local_id = get_local_id (0);
+      int local_size = get_local_size (0);
+
+      const int bins = % d;
+      const int copies = % d;
+      const int has_weights = % d;
+      const int has_edges = % d;
+      __local int hist[copies ? copies * bins : 1];
+      __local % s edges[has_edges ? bins + 1 : 1];
+
+      for (int b = local_id; b < copies * bins; b += local_size)
+        {
+          hist[b] = 0;
+        }
+      for (int b = local_id; has_edges && b <= bins; b += local_size)
+        {
+          edges[b] = E[b];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      int total = a1 * a2 * a3;
+      int copy = copies ? (local_id & (copies - 1)) * bins : 0;
+      % s scale = bins / (hi - lo);
+      for (int i = get_global_id (0); i < total; i += get_global_size (0))
+        {
+          % s x = A[i];
+          int bin = -1;
+          if (has_edges)
+            {
+              if (x >= edges[0] && x <= edges[bins])
+                {
+                  int first = 0;
+                  int last = bins;
+                  while (last - first > 1)
+                    {
+                      int mid = (first + last) / 2;
+                      if (x < edges[mid])
+                        {
+                          last = mid;
+                        }
+                      else
+                        {
+                          first = mid;
+                        }
+                    }
+                  bin = first;
+                }
+            }
+          else if (x >= lo && x <= hi)
+            {
+              bin = min ((int)((x - lo) * scale), bins - 1);
+            }
+
+          if (bin >= 0)
+            {
+              % s v = has_weights ? (% s)W[i] : (% s)1;
+              if (copies)
+                {
+                  hist_add_local (&hist[copy + bin], v);
+                }
+              else
+                {
+                  hist_add_global (&H[bin], v);
+                }
+            }
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      for (int b = local_id; copies && b < bins; b += local_size)
+        {
+          % s sum = 0;
+          for (int c = 0; c < copies; c++)
+            {
+              sum += hist_value (hist[c * bins + b]);
+            }
+          if (sum != 0)
+            {
+              hist_add_global (&H[b], sum);
+            }
+        }
+    });
+
+/*
+** Bins are stored as int bits in both local and global memory so the same
+** atomic update works for either address space.
+*/
+static const char *
+get_histogram_add (const char *htype, const char **value)
+{
+  if (strcmp (htype, "int") == 0)
+    {
+      *value = "bits";
+      return "atomic_add (p, v);";
+    }
+  if (strcmp (htype, "float") == 0)
+    {
+      *value = "as_float (bits)";
+      return "int old = *p; int prev; "
+             "while ((prev = atomic_cmpxchg (p, old, "
+             "as_int (as_float (old) + v))) != old) { old = prev; }";
+    }
+
+  handle_error ("Unimplemented histogram type %s, use int or float", htype);
+  *value = "bits";
+  return "";
+}
+
+char *
+get_histogram (const char *atype, const char *wtype, const char *etype,
+               const char *htype, int bins, int copies, int has_weights,
+               int has_edges)
+{
+  const char *value;
+  const char *add = get_histogram_add (htype, &value);
+  // Floats only hold integers exactly up to 2^24, so int and long elements
+  // are binned in double like double elements.
+  const char *xtype = (strcmp (atype, "double") == 0
+                       || strcmp (atype, "long") == 0
+                       || strcmp (atype, "int") == 0)
+                          ? "double"
+                          : "float";
+
+  int size = snprintf (NULL, 0, _histogram_fmt, htype, add, htype, add, htype,
+                       value, atype, wtype, etype, xtype, xtype, bins, copies,
+                       has_weights, has_edges, xtype, xtype, xtype, htype,
+                       htype, htype, htype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _histogram_fmt, htype, add, htype,
+                        add, htype, value, atype, wtype, etype, xtype, xtype,
+                        bins, copies, has_weights, has_edges, xtype, xtype,
+                        xtype, htype, htype, htype, htype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+histogram (array A, array *W, array *E, double lo, double hi, array H,
+           cl_event *event)
+{
+  int bins = ARRAY_SIZE (H);
+  if (E && ARRAY_SIZE ((*E)) != bins + 1)
+    {
+      handle_error ("Histogram of %d bins needs %d edges, got %d", bins,
+                    bins + 1, ARRAY_SIZE ((*E)));
+      return 0;
+    }
+  if (!E && !(hi > lo))
+    {
+      handle_error ("Histogram range [%f, %f] is empty", lo, hi);
+      return 0;
+    }
+
+  int copies = 0;
+  if (bins <= HISTOGRAM_MAX_LOCAL_BINS)
+    {
+      copies = 1;
+      while (copies < 4 && 2 * copies * bins <= HISTOGRAM_MAX_LOCAL_BINS)
+        copies *= 2;
+    }
+
+  const char *atype = TYPE_STR_FROM_ENUM (A.type);
+  char *src = get_histogram (atype, W ? TYPE_STR_FROM_ENUM (W->type) : atype,
+                             E ? TYPE_STR_FROM_ENUM (E->type) : atype,
+                             TYPE_STR_FROM_ENUM (H.type), bins, copies,
+                             W != NULL, E != NULL);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  int idx = set_kernel_args (kernel, 4, A, W ? *W : A, E ? *E : A, H);
+  if (A.type == TYPE_DOUBLE || A.type == TYPE_LONG || A.type == TYPE_INT)
+    {
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (double), &lo));
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (double), &hi));
+    }
+  else
+    {
+      float flo = lo;
+      float fhi = hi;
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (float), &flo));
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (float), &fhi));
+    }
+
+  cl_event partials[2];
+  int event_count = 0;
+  int zero = 0;
+  CHECK_CL (clEnqueueFillBuffer (_queue, H.device, &zero, sizeof (zero), 0,
+                                 ARRAY_SIZE (H) * H.membsize, 0, NULL,
+                                 &partials[event_count++]));
+
+  size_t local_size[] = { _tile_size * _tile_size };
+  size_t groups
+      = (ARRAY_SIZE (A) + HISTOGRAM_ITEMS_PER_WORK_ITEM * local_size[0] - 1)
+        / (HISTOGRAM_ITEMS_PER_WORK_ITEM * local_size[0]);
+  size_t global_size[] = { groups * local_size[0] };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    &partials[event_count++]));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file histogram.h
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include "cl_utils.h"
+
+/**
+ * @brief Bins privatized per work group in local memory, can be overriden.
+ *
+ * Histograms with more bins than this are accumulated directly in global
+ * memory. Smaller histograms are replicated up to four times in local memory
+ * to spread contention on popular bins.
+ */
+#ifndef HISTOGRAM_MAX_LOCAL_BINS
+#define HISTOGRAM_MAX_LOCAL_BINS 4096
+#endif
+
+extern const char *_histogram_fmt;
+/**
+ * @brief Composes histogram kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the fourth input argument H, adds the count of the elements of A that
+ * fall into each bin, or the sum of their weights in W if has_weights is set.
+ * Bins are delimited by the edges in E if has_edges is set, otherwise they
+ * split the range between the lo and hi arguments uniformly.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param wtype String for type of second @ref array of kernel: W.
+ * @param etype String for type of third @ref array of kernel: E.
+ * @param htype String for type of fourth @ref array of kernel: H.
+ * @param bins Number of bins.
+ * @param copies Copies of the histogram in local memory, or 0 for none.
+ * @param has_weights Whether elements are weighted by W.
+ * @param has_edges Whether bins are delimited by E.
+ * @return Pointer to null-terminated string.
+ */
+char *get_histogram (const char *atype, const char *wtype, const char *etype,
+                     const char *htype, int bins, int copies, int has_weights,
+                     int has_edges);
+/**
+ * @brief Perform histogram operation.
+ *
+ * Overwrites H with the histogram of A, with as many bins as elements of H.
+ * Bins split `[lo, hi]` uniformly, for hi greater than lo, or are delimited
+ * by the increasing edges in E, which has one more element than H. Elements
+ * outside the bins are ignored, and the last bin includes its upper edge.
+ * Elements are binned in double if they are int, long or double, and in float
+ * otherwise, so every value is placed exactly. Counts are accumulated
+ * into an int H, or weights of W into an int or float H. Blocks and attempts
+ * to record timing if no cl_event is provided, non blocking otherwise.
+ *
+ * @param A @ref array of elements to bin.
+ * @param W Optional. @ref array of weights of each element, or NULL.
+ * @param E Optional. @ref array of bin edges, or NULL.
+ * @param lo Lower edge of the first bin, ignored if E is given.
+ * @param hi Upper edge of the last bin, ignored if E is given.
+ * @param H @ref array to write the histogram into.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // 64 bins between 0 and 1
+ * array H = ALLOC_ARRAY (int, CL_MEM_READ_WRITE, 64);
+ * HISTOGRAM(0.0, 1.0, A, H);
+ * // Sum of weights of A in bins delimited by edges
+ * cl_event event;
+ * array WH = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, edges.dim1 - 1);
+ * WEIGHTED_HISTOGRAM_BY_EDGES(edges, A, weights, WH, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long histogram (array A, array *W, array *E, double lo,
+                              double hi, array H, cl_event *event);
+#define _HISTOGRAM_ONE(lo, hi, A, H)                                          \
+  histogram (A, NULL, NULL, lo, hi, H, NULL);
+#define _HISTOGRAM_TWO(lo, hi, A, H, event)                                   \
+  histogram (A, NULL, NULL, lo, hi, H, event)
+#define HISTOGRAM(...)                                                        \
+  _GETM_FIVE (__VA_ARGS__, _HISTOGRAM_TWO,                                    \
+              _HISTOGRAM_ONE) (__VA_ARGS__) /**< @copydoc histogram*/
+#define _WEIGHTED_HISTOGRAM_ONE(lo, hi, A, W, H)                              \
+  histogram (A, &(W), NULL, lo, hi, H, NULL);
+#define _WEIGHTED_HISTOGRAM_TWO(lo, hi, A, W, H, event)                       \
+  histogram (A, &(W), NULL, lo, hi, H, event)
+#define WEIGHTED_HISTOGRAM(...)                                               \
+  _GETM_SIX (__VA_ARGS__, _WEIGHTED_HISTOGRAM_TWO,                            \
+             _WEIGHTED_HISTOGRAM_ONE) (__VA_ARGS__) /**< @copydoc histogram*/
+#define _HISTOGRAM_BY_EDGES_ONE(E, A, H)                                      \
+  histogram (A, NULL, &(E), 0, 0, H, NULL);
+#define _HISTOGRAM_BY_EDGES_TWO(E, A, H, event)                               \
+  histogram (A, NULL, &(E), 0, 0, H, event)
+#define HISTOGRAM_BY_EDGES(...)                                               \
+  _GETM_FOUR (__VA_ARGS__, _HISTOGRAM_BY_EDGES_TWO,                           \
+              _HISTOGRAM_BY_EDGES_ONE) (__VA_ARGS__) /**< @copydoc histogram*/
+#define _WEIGHTED_HISTOGRAM_BY_EDGES_ONE(E, A, W, H)                          \
+  histogram (A, &(W), &(E), 0, 0, H, NULL);
+#define _WEIGHTED_HISTOGRAM_BY_EDGES_TWO(E, A, W, H, event)                   \
+  histogram (A, &(W), &(E), 0, 0, H, event)
+#define WEIGHTED_HISTOGRAM_BY_EDGES(...)                                      \
+  _GETM_FIVE (__VA_ARGS__, _WEIGHTED_HISTOGRAM_BY_EDGES_TWO,                  \
+              _WEIGHTED_HISTOGRAM_BY_EDGES_ONE) (                             \
+      __VA_ARGS__) /**< @copydoc histogram*/
+
+#endif // HISTOGRAM_H_
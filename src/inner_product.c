@@ -1,65 +1,342 @@
 #include "inner_product.h"
 #include "cl_utils.h"
+#include "gemm.h"
+#include "qgemm.h"
 #include <stdio.h>
+#include <string.h>
+
+/*
+** Depth of the inner dimension below which a split is not worth the extra
+** pass reducing its partial products.
+*/
+#define INNER_PRODUCT_SPLIT_DEPTH 512
 
-// TODO: avoid identity elements
 /* Format strings:
-** 1. A type
+** 1. B type
 ** 2. B type
+*/
+const char *_inner_product_load_fmt = RAW (
+    % s load_b (__global const % s * B, const int b1, const int b2, int k,
+                int col) {
+      return (k < b2 && col < b1) ? B[k * b1 + col] : 0;
+    });
+
+/* Format strings:
+** 1. C type
+** 2. C type
 ** 3. C type
-** 4. TILE_SIZE
-** 5. A_tile type
-** 6. B_tile type
+** 4. OP1 expression
+** 5. C type
+** 6. A type
+** 7. B type
+** 8. OP2 expression
+** 9. B loader
+** 10. A type
+** 11. B type
+** 12. C type
+** 13. M type
+** 14. TILE_SIZE
+** 15. lower
+** 16. upper
+** 17. symmetric
+** 18. a_lower
+** 19. a_upper
+** 20. b_lower
+** 21. b_upper
+** 22. has_mask
+** 23. A_tile type
+** 24. B_tile type
+** 25. acc type
+*/
+const char *_inner_product_fmt = RAW (
+    % s reduce (% s a, % s b) { return % s; }
+
+    % s pair (% s a, % s b) { return % s; }
+
+    % s
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int b1, const int b2, const int b3, __global const % s * B,
+        const int c1, const int c2, const int c3, __global % s * C,
+        const int m1, const int m2, const int m3, __global const % s * M,
+        const int splits, const int chunk) {
+      int row = get_global_id (1);
+      int col = get_global_id (0);
+      int batch = get_global_id (2) / splits;
+      int split = get_global_id (2) - batch * splits;
+      const int tile_size = % d;
+      const int lower = % d;
+      const int upper = % d;
+      const int symmetric = % d;
+      const int a_lower = % d;
+      const int a_upper = % d;
+      const int b_lower = % d;
+      const int b_upper = % d;
+      const int has_mask = % d;
+
+      // Operands with a single matrix are shared by every batch, and each
+      // split of the inner dimension writes its own matrix of partials.
+      A += (a3 > 1) * batch * a1 * a2;
+      B += (b3 > 1) * batch * b1 * b2;
+      C += get_global_id (2) * c1 * c2;
+      M += (m3 > 1) * batch * m1 * m2;
+
+      // Tiles of C entirely outside the output triangle or the block mask
+      // are skipped by the whole work group.
+      int row_first = get_group_id (1) * tile_size;
+      int col_first = get_group_id (0) * tile_size;
+      int row_last = row_first + tile_size - 1;
+      int col_last = col_first + tile_size - 1;
+      if (((lower || symmetric) && row_last < col_first)
+          || (upper && row_first > col_last))
+        {
+          return;
+        }
+      int block1 = (c1 + m1 - 1) / m1;
+      int block2 = (c2 + m2 - 1) / m2;
+      if (has_mask)
+        {
+          int any = 0;
+          for (int y = row_first / block2;
+               y <= min (row_last, c2 - 1) / block2; y++)
+            {
+              for (int x = col_first / block1;
+                   x <= min (col_last, c1 - 1) / block1; x++)
+                {
+                  any |= M[y * m1 + x] != 0;
+                }
+            }
+          if (!any)
+            {
+              return;
+            }
+        }
+
+      // Triangular operands only contribute within their triangle, which
+      // bounds the inner dimension of each element and of the whole tile.
+      int k_begin = split * chunk;
+      int k_end = min (a1, k_begin + chunk);
+      int k_lo = k_begin;
+      int k_hi = k_end;
+      if (a_lower)
+        {
+          k_hi = min (k_hi, row + 1);
+          k_end = min (k_end, row_last + 1);
+        }
+      if (a_upper)
+        {
+          k_lo = max (k_lo, row);
+          k_begin = max (k_begin, row_first);
+        }
+      if (b_lower)
+        {
+          k_lo = max (k_lo, col);
+          k_begin = max (k_begin, col_first);
+        }
+      if (b_upper)
+        {
+          k_hi = min (k_hi, col + 1);
+          k_end = min (k_end, col_last + 1);
+        }
+
+      int local_row = get_local_id (1);
+      int local_col = get_local_id (0);
+
+      __local % s A_tile[tile_size][tile_size];
+      __local % s B_tile[tile_size][tile_size];
+
+      % s acc;
+      int started = 0;
+
+      for (int t = 0; t < (k_end - k_begin + tile_size - 1) / tile_size; t++)
+        {
+          int base = k_begin + t * tile_size;
+          int tiled_col_A = base + local_col;
+          int tiled_row_B = base + local_row;
+
+          A_tile[local_row][local_col] = (row < a2 && tiled_col_A < k_end)
+                                             ? A[row * a1 + tiled_col_A]
+                                             : 0;
+          B_tile[local_row][local_col]
+              = tiled_row_B < k_end ? load_b (B, b1, b2, tiled_row_B, col)
+                                    : 0;
+          barrier (CLK_LOCAL_MEM_FENCE);
+
+          // Padding is never reduced, so no identity element is needed.
+          int k = max (0, k_lo - base);
+          int valid = min (tile_size, k_hi - base);
+          if (!started && k < valid)
+            {
+              acc = pair (A_tile[local_row][k], B_tile[k][local_col]);
+              started = 1;
+              k++;
+            }
+          for (; k < valid; ++k)
+            {
+              acc = reduce (acc,
+                            pair (A_tile[local_row][k], B_tile[k][local_col]));
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+
+      int keep = started && row < c2 && col < c1;
+      keep = keep && (!(lower || symmetric) || row >= col);
+      keep = keep && (!upper || row <= col);
+      if (keep && has_mask)
+        {
+          keep = M[(row / block2) * m1 + col / block1] != 0;
+        }
+      if (keep)
+        {
+          C[row * c1 + col] = acc;
+          if (symmetric && row != col)
+            {
+              C[col * c1 + row] = acc;
+            }
+        }
+    });
+
+/* Format strings:
+** 1. C type
+** 2. C type
+** 3. C type
+** 4. OP1 expression
+** 5. P type
+** 6. C type
 ** 7. acc type
-** 8. OP1
-** 9. OP2
 */
-const char *_inner_product_fmt = RAW (__kernel void entry (
-    const int a1, const int a2, const int a3, __global const % s * A,
-    const int b1, const int b2, const int b3, __global const % s * B,
-    const int c1, const int c2, const int c3, __global % s * C) {
-  int row = get_global_id (1);
-  int col = get_global_id (0);
+const char *_inner_product_split_fmt = RAW (
+    % s reduce (% s a, % s b) { return % s; }
 
-  int local_row = get_local_id (1);
-  int local_col = get_local_id (0);
-  const int tile_size = % d;
+    __kernel void entry (
+        const int p1, const int p2, const int p3, __global const % s * P,
+        const int c1, const int c2, const int c3, __global % s * C,
+        const int splits) {
+      int i = get_global_id (0);
+      int batch = get_global_id (1);
+      int size = c1 * c2;
 
-  __local % s A_tile[tile_size][tile_size];
-  __local % s B_tile[tile_size][tile_size];
+      if (i < size)
+        {
+          P += batch * splits * size;
+          % s acc = P[i];
+          for (int s = 1; s < splits; s++)
+            {
+              acc = reduce (acc, P[s * size + i]);
+            }
+          C[batch * size + i] = acc;
+        }
+    });
 
-  % s acc = 0;
+/* Format strings:
+** 1. C type
+** 2. C type
+** 3. C type
+** 4. OP1 expression
+** 5. C type
+** 6. A type
+** 7. B type
+** 8. OP2 expression
+** 9. A type
+** 10. B type
+** 11. C type
+** 12. partial type
+** 13. local size
+** 14. acc type
+*/
+const char *_inner_product_gemv_fmt = RAW (
+    % s reduce (% s a, % s b) { return % s; }
 
-  for (int t = 0; t < (a1 + tile_size - 1) / tile_size; t++)
-    {
-      int tiled_col_A = t * tile_size + local_col;
-      int tiled_row_B = t * tile_size + local_row;
+    % s pair (% s a, % s b) { return % s; }
 
-      A_tile[local_row][local_col]
-          = (row < a2 && tiled_col_A < a1) ? A[row * a1 + tiled_col_A] : 0;
-      B_tile[local_row][local_col]
-          = (tiled_row_B < b2 && col < b1) ? B[tiled_row_B * b1 + col] : 0;
-      barrier (CLK_LOCAL_MEM_FENCE);
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int b1, const int b2, const int b3, __global const % s * B,
+        const int c1, const int c2, const int c3, __global % s * C) {
+      int row = get_group_id (0);
+      int batch = get_global_id (1);
+      int local_id = get_local_id (0);
+      const int local_size = get_local_size (0);
+
+      A += (a3 > 1) * batch * a1 * a2 + row * a1;
+      B += (b3 > 1) * batch * b1 * b2;
+      C += batch * c1 * c2;
+
+      __local % s partial[% d];
 
-      for (int k = 0; k < tile_size; ++k)
+      // Each work item reduces a strided slice of the row, then the slices
+      // are combined in a tree over the work items that saw any element.
+      if (local_id < a1)
         {
-          acc = acc % s (A_tile[local_row][k] % s B_tile[k][local_col]);
+          % s acc = pair (A[local_id], B[local_id * b1]);
+          for (int k = local_id + local_size; k < a1; k += local_size)
+            {
+              acc = reduce (acc, pair (A[k], B[k * b1]));
+            }
+          partial[local_id] = acc;
         }
       barrier (CLK_LOCAL_MEM_FENCE);
+
+      int n = min (local_size, a1);
+      for (int s = local_size / 2; s > 0; s >>= 1)
+        {
+          if (local_id < s && local_id + s < n)
+            {
+              partial[local_id] = reduce (partial[local_id],
+                                          partial[local_id + s]);
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+
+      if (local_id == 0)
+        {
+          C[row * c1] = partial[0];
+        }
+    });
+
+char *
+get_inner_product_load (const char *btype)
+{
+  int size = snprintf (NULL, 0, _inner_product_load_fmt, btype, btype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
     }
 
-  if (row < c2 && col < c1)
+  int count
+      = snprintf (kernel, size + 1, _inner_product_load_fmt, btype, btype);
+  if (count == -1)
     {
-      C[row * c1 + col] = acc;
+      handle_error ("Failed to print to kernel string");
     }
-});
+
+  return kernel;
+}
 
 char *
 get_inner_product (const char *atype, const char *btype, const char *ctype,
-                   const char *op1, const char *op2)
+                   const char *mtype, const char *op1, const char *op2,
+                   int structure, int has_mask, const char *load_b)
 {
-  int size = snprintf (NULL, 0, _inner_product_fmt, atype, btype, ctype,
-                       _tile_size, atype, btype, ctype, op1, op2);
+  char *reduce = get_op_expression (op1);
+  char *pair = get_op_expression (op2);
+  char *load = load_b ? NULL : get_inner_product_load (btype);
+  const char *loader = load_b ? load_b : load;
+  int lower = (structure & INNER_PRODUCT_LOWER) != 0;
+  int upper = (structure & INNER_PRODUCT_UPPER) != 0;
+  int symmetric = (structure & INNER_PRODUCT_SYMMETRIC) != 0;
+  int a_lower = (structure & INNER_PRODUCT_A_LOWER) != 0;
+  int a_upper = (structure & INNER_PRODUCT_A_UPPER) != 0;
+  int b_lower = (structure & INNER_PRODUCT_B_LOWER) != 0;
+  int b_upper = (structure & INNER_PRODUCT_B_UPPER) != 0;
+  int size = snprintf (NULL, 0, _inner_product_fmt, ctype, ctype, ctype,
+                       reduce, ctype, atype, btype, pair, loader, atype, btype,
+                       ctype, mtype, _tile_size, lower, upper, symmetric,
+                       a_lower, a_upper, b_lower, b_upper, has_mask, atype,
+                       btype, ctype);
 
   char *kernel = malloc (size + 1);
   if (!kernel)
@@ -67,34 +344,102 @@ get_inner_product (const char *atype, const char *btype, const char *ctype,
       handle_error ("Failed to allocate memory for kernel string");
     }
 
-  int count = snprintf (kernel, size + 1, _inner_product_fmt, atype, btype,
-                        ctype, _tile_size, atype, btype, ctype, op1, op2);
+  int count = snprintf (kernel, size + 1, _inner_product_fmt, ctype, ctype,
+                        ctype, reduce, ctype, atype, btype, pair, loader,
+                        atype, btype, ctype, mtype, _tile_size, lower, upper,
+                        symmetric, a_lower, a_upper, b_lower, b_upper,
+                        has_mask, atype, btype, ctype);
   if (count == -1)
     {
       handle_error ("Failed to print to kernel string");
     }
+  free (reduce);
+  free (pair);
+  free (load);
 
   return kernel;
 }
 
-unsigned long long
-inner_product (const char *op1, const char *op2, array A, array B, array C,
-               cl_event *event)
+char *
+get_inner_product_split (const char *ptype, const char *ctype, const char *op1)
+{
+  char *reduce = get_op_expression (op1);
+  int size = snprintf (NULL, 0, _inner_product_split_fmt, ctype, ctype, ctype,
+                       reduce, ptype, ctype, ctype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _inner_product_split_fmt, ctype,
+                        ctype, ctype, reduce, ptype, ctype, ctype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (reduce);
+
+  return kernel;
+}
+
+char *
+get_inner_product_gemv (const char *atype, const char *btype,
+                        const char *ctype, const char *op1, const char *op2,
+                        int local_size)
+{
+  char *reduce = get_op_expression (op1);
+  char *pair = get_op_expression (op2);
+  int size = snprintf (NULL, 0, _inner_product_gemv_fmt, ctype, ctype, ctype,
+                       reduce, ctype, atype, btype, pair, atype, btype, ctype,
+                       ctype, local_size, ctype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _inner_product_gemv_fmt, ctype,
+                        ctype, ctype, reduce, ctype, atype, btype, pair,
+                        atype, btype, ctype, ctype, local_size, ctype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (reduce);
+  free (pair);
+
+  return kernel;
+}
+
+/*
+** Matrix-vector products get a work group per row of A, sized to the power
+** of two covering the row up to a tile's area, instead of a tile of C that
+** would be almost all padding.
+*/
+static unsigned long long
+inner_product_gemv (const char *op1, const char *op2, array A, array B,
+                    array C, cl_event *event)
 {
   cl_event _event;
-  char *src = get_inner_product (TYPE_STR_FROM_ENUM (A.type),
-                                 TYPE_STR_FROM_ENUM (B.type),
-                                 TYPE_STR_FROM_ENUM (C.type), op1, op2);
+  int local = 1;
+  while (local < A.dim1 && 2 * local <= _tile_size * _tile_size)
+    local *= 2;
+
+  char *src = get_inner_product_gemv (TYPE_STR_FROM_ENUM (A.type),
+                                      TYPE_STR_FROM_ENUM (B.type),
+                                      TYPE_STR_FROM_ENUM (C.type), op1, op2,
+                                      local);
   cl_kernel kernel = TRY_COMPILE_KERNEL (src);
   free (src);
   SET_KERNEL_ARGS (kernel, A, B, C);
 
-  size_t local_size[] = { _tile_size, _tile_size, _tile_size };
-  size_t global_size[]
-      = { LOWEST_MULTIPLE_OF_TILE (C.dim1), LOWEST_MULTIPLE_OF_TILE (C.dim2),
-          LOWEST_MULTIPLE_OF_TILE (C.dim3) };
-  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, ARRAY_NUM_DIMS (C), NULL,
-                                    global_size, local_size, 0, NULL,
+  size_t local_size[] = { local, 1 };
+  size_t global_size[] = { C.dim2 * local_size[0], C.dim3 };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 2, NULL, global_size,
+                                    local_size, 0, NULL,
                                     event ? event : &_event));
 
   unsigned long long time = 0;
@@ -109,3 +454,152 @@ inner_product (const char *op1, const char *op2, array A, array B, array C,
 
   return time;
 }
+
+/*
+** When C has too few tiles to occupy every compute unit, the inner
+** dimension is split into chunks of whole tiles whose partial products are
+** reduced by a second kernel. Every chunk is non empty, so partials never
+** need an identity element either.
+*/
+static int
+get_inner_product_splits (array A, array C, int *chunk)
+{
+  int tiles = ((C.dim1 + _tile_size - 1) / _tile_size)
+              * ((C.dim2 + _tile_size - 1) / _tile_size) * C.dim3;
+  cl_uint units = 1;
+  CHECK_CL (clGetDeviceInfo (_device, CL_DEVICE_MAX_COMPUTE_UNITS,
+                             sizeof (units), &units, NULL));
+
+  *chunk = A.dim1;
+  int splits = A.dim1 / INNER_PRODUCT_SPLIT_DEPTH;
+  if (tiles >= (int)units || splits < 2)
+    return 1;
+
+  int wanted = (4 * units + tiles - 1) / tiles;
+  splits = splits < wanted ? splits : wanted;
+  *chunk = (A.dim1 + splits - 1) / splits;
+  *chunk = ((*chunk + _tile_size - 1) / _tile_size) * _tile_size;
+  return (A.dim1 + *chunk - 1) / *chunk;
+}
+
+unsigned long long
+inner_product_loader (const char *op1, const char *op2, int structure,
+                      array A, array B, array *M, array C, const char *load_b,
+                      cl_event *event)
+{
+  if ((A.dim3 != C.dim3 && A.dim3 != 1) || (B.dim3 != C.dim3 && B.dim3 != 1))
+    {
+      handle_error ("Cannot batch %d and %d matrices into %d", A.dim3, B.dim3,
+                    C.dim3);
+      return 0;
+    }
+  if ((structure & INNER_PRODUCT_SYMMETRIC) && C.dim1 != C.dim2)
+    {
+      handle_error ("Symmetric product into %dx%d matrix, which is not square",
+                    C.dim1, C.dim2);
+      return 0;
+    }
+  if (M && M->dim3 != 1 && M->dim3 != C.dim3)
+    {
+      handle_error ("Cannot mask %d matrices with %d masks", C.dim3, M->dim3);
+      return 0;
+    }
+
+  if (C.dim1 == 1 && !structure && !M && !load_b)
+    return inner_product_gemv (op1, op2, A, B, C, event);
+
+  // Small products would leave most of a register blocked work group idle.
+  int block = _tile_size * GEMM_WORK_PER_THREAD;
+  int large = C.dim1 >= block && C.dim2 >= block;
+  if (strcmp (op1, "+") == 0 && strcmp (op2, "*") == 0 && large && !M
+      && gemm_supported (A, B, C))
+    return gemm_loader (structure, A, B, C, load_b, event);
+  if (strcmp (op1, "+") == 0 && strcmp (op2, "*") == 0 && large
+      && !structure && !M && !load_b && A.type == TYPE_CHAR
+      && B.type == TYPE_CHAR && C.type == TYPE_INT
+      && _tile_size % GEMM_WORK_PER_THREAD == 0)
+    return qgemm (A, NULL, NULL, B, NULL, NULL, C, event);
+
+  // Splits could leave elements of a structured product without partials.
+  int chunk = A.dim1;
+  int splits = 1;
+  if (!structure && !M)
+    splits = get_inner_product_splits (A, C, &chunk);
+  array P = C;
+  if (splits > 1)
+    P = alloc_array (C.type, CL_MEM_READ_WRITE, C.dim1, C.dim2,
+                     C.dim3 * splits);
+
+  char *src = get_inner_product (TYPE_STR_FROM_ENUM (A.type),
+                                 TYPE_STR_FROM_ENUM (B.type),
+                                 TYPE_STR_FROM_ENUM (C.type),
+                                 TYPE_STR_FROM_ENUM (M ? M->type : C.type),
+                                 op1, op2, structure, M != NULL, load_b);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  int idx = set_kernel_args (kernel, 4, A, B, P, M ? *M : C);
+  CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (int), &splits));
+  CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (int), &chunk));
+
+  cl_event partials[2];
+  int event_count = 0;
+  size_t local_size[] = { _tile_size, _tile_size, 1 };
+  size_t global_size[] = { LOWEST_MULTIPLE_OF_TILE (C.dim1),
+                           LOWEST_MULTIPLE_OF_TILE (C.dim2), P.dim3 };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    &partials[event_count++]));
+
+  if (splits > 1)
+    {
+      const char *ctype = TYPE_STR_FROM_ENUM (C.type);
+      char *src_split = get_inner_product_split (ctype, ctype, op1);
+      cl_kernel kernel_split = TRY_COMPILE_KERNEL (src_split);
+      free (src_split);
+      int split_idx = SET_KERNEL_ARGS (kernel_split, P, C);
+      CHECK_CL (
+          clSetKernelArg (kernel_split, split_idx, sizeof (int), &splits));
+
+      size_t split_local_size[] = { _tile_size, 1 };
+      size_t split_global_size[]
+          = { LOWEST_MULTIPLE_OF_TILE (C.dim1 * C.dim2), C.dim3 };
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel_split, 2, NULL,
+                                        split_global_size, split_local_size,
+                                        0, NULL, &partials[event_count++]));
+      FREE_ARRAY (P);
+    }
+
+  unsigned long long time = 0;
+
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
+
+unsigned long long
+inner_product_structured (const char *op1, const char *op2, int structure,
+                          array A, array B, array *M, array C,
+                          cl_event *event)
+{
+  return inner_product_loader (op1, op2, structure, A, B, M, C, NULL, event);
+}
+
+unsigned long long
+inner_product (const char *op1, const char *op2, array A, array B, array C,
+               cl_event *event)
+{
+  return inner_product_structured (op1, op2, 0, A, B, NULL, C, event);
+}
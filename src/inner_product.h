@@ -7,7 +7,46 @@
 
 #include "cl_utils.h"
 
+/**
+ * @brief Structure flags of inner products, combined with bitwise or.
+ *
+ * Output flags restrict which elements of C are written, leaving the others
+ * untouched. Operand flags restrict the reduction of each element to the
+ * triangle of the operand, ignoring whatever is stored outside it. Elements
+ * left with nothing to reduce, such as those above the diagonal of a product
+ * of lower triangular operands, are untouched as well.
+ */
+typedef enum
+{
+  INNER_PRODUCT_LOWER = 1 << 0,     /**< Write C where row >= column. */
+  INNER_PRODUCT_UPPER = 1 << 1,     /**< Write C where row <= column. */
+  INNER_PRODUCT_SYMMETRIC = 1 << 2, /**< Mirror the lower triangle of C. */
+  INNER_PRODUCT_A_LOWER = 1 << 3,   /**< A is lower triangular. */
+  INNER_PRODUCT_A_UPPER = 1 << 4,   /**< A is upper triangular. */
+  INNER_PRODUCT_B_LOWER = 1 << 5,   /**< B is lower triangular. */
+  INNER_PRODUCT_B_UPPER = 1 << 6,   /**< B is upper triangular. */
+} inner_product_structure;
+
+extern const char *_inner_product_load_fmt;
 extern const char *_inner_product_fmt;
+extern const char *_inner_product_split_fmt;
+extern const char *_inner_product_gemv_fmt;
+/**
+ * @brief Composes matrix loader of inner product kernels.
+ *
+ * Constructs the kernel function with the specified type, return an
+ * allocated null-terminated string containing the function.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Defines `load_b (B, b1, b2, k, col)`, returning the element of B at row k
+ * and column col, or 0 outside of B. Other loaders with the same signature
+ * let inner products compute B on the fly rather than read it.
+ *
+ * @param btype String for type of second @ref array of kernel: B.
+ * @return Pointer to null-terminated string.
+ */
+char *get_inner_product_load (const char *btype);
 /**
  * @brief Composes inner product kernel.
  *
@@ -18,23 +57,82 @@ extern const char *_inner_product_fmt;
  *
  * Onto the third input argument C, the result of evaluating the op2 is
  * written for each row-column pair of A and B, reduced by op1. op1 and op2
- * must be binary operators.
+ * must be binary operators, or names of functions of two arguments such as
+ * min. Reductions start from the first pair rather than an identity element,
+ * so any semiring can be used. The inner dimension may be split into chunks
+ * given by the splits and chunk arguments, each writing its partial products
+ * into its own matrix of C. Tiles outside the structure, or whose blocks in
+ * the fourth input argument M are all zero if has_mask is set, are skipped.
+ * Elements of B are read through load_b, as defined by @ref
+ * get_inner_product_load.
  *
  * @param atype String for type of first @ref array of kernel: A.
  * @param btype String for type of second @ref array of kernel: B.
  * @param ctype String for type of third @ref array of kernel: C.
+ * @param mtype String for type of fourth @ref array of kernel: M.
  * @param op1 String for the reducing operation the kernel performs.
  * @param op2 String for the pairwise operation the kernel performs.
+ * @param structure Bitwise or of @ref inner_product_structure flags.
+ * @param has_mask Whether blocks of C are masked by M.
+ * @param load_b String defining `load_b`, or NULL to read B as a matrix.
  * @return Pointer to null-terminated string.
  */
 char *get_inner_product (const char *atype, const char *btype,
-                         const char *ctype, const char *op1, const char *op2);
+                         const char *ctype, const char *mtype,
+                         const char *op1, const char *op2, int structure,
+                         int has_mask, const char *load_b);
+/**
+ * @brief Composes split inner product reduction kernel.
+ *
+ * Constructs the kernel with the specified types and operation, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the second input argument C, reduces by op1 the partial products in P
+ * of the number of splits given by the splits argument.
+ *
+ * @param ptype String for type of first @ref array of kernel: P.
+ * @param ctype String for type of second @ref array of kernel: C.
+ * @param op1 String for the reducing operation the kernel performs.
+ * @return Pointer to null-terminated string.
+ */
+char *get_inner_product_split (const char *ptype, const char *ctype,
+                               const char *op1);
+/**
+ * @brief Composes matrix-vector inner product kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Like @ref get_inner_product for a C with a single column, where each work
+ * group of local_size work items reduces a row of A against B.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param btype String for type of second @ref array of kernel: B.
+ * @param ctype String for type of third @ref array of kernel: C.
+ * @param op1 String for the reducing operation the kernel performs.
+ * @param op2 String for the pairwise operation the kernel performs.
+ * @param local_size Work items per row, a power of two.
+ * @return Pointer to null-terminated string.
+ */
+char *get_inner_product_gemv (const char *atype, const char *btype,
+                              const char *ctype, const char *op1,
+                              const char *op2, int local_size);
 /**
  * @brief Perform inner product operation.
  *
- * Calls inner product kernel on given input @ref array "arrays". Blocks and
- * attempts to record timing if no cl_event is provided, non blocking
- * otherwise.
+ * Calls inner product kernel on given input @ref array "arrays", or the
+ * register blocked @ref gemm kernel for `+` and `*` when it supports them and
+ * C is large enough, or the @ref qgemm kernel for products of char into int.
+ * Products into a single column use a kernel reducing each row of A in its
+ * own work group, and products with too few tiles to occupy the device split
+ * the inner dimension across work groups. Matrices stacked along the third
+ * dimension are multiplied as a batch in a single launch, where A or B may
+ * hold a single matrix shared by every product. Blocks and attempts to record
+ * timing if no cl_event is provided, non blocking otherwise.
  *
  * @param op1 String of reducing operation to perform.
  * @param op2 String of pairwise operation to perform.
@@ -50,6 +148,17 @@ char *get_inner_product (const char *atype, const char *btype,
  * cl_event event;
  * INNER_PRODUCT("+", "*", A, B, C, &event);
  * clWaitForEvents(1, &event);
+ * // Shortest paths of up to two edges, with INFINITY for missing edges
+ * INNER_PRODUCT("min", "+", D, D, D2);
+ * // Reachability in two steps of boolean adjacency matrices
+ * INNER_PRODUCT("||", "&&", R, R, R2);
+ * // A thousand 32x32 products, all with the same right operand
+ * array As = ALLOC_ARRAY (float, CL_MEM_READ_ONLY, 32, 32, 1000);
+ * array Cs = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, 32, 32, 1000);
+ * INNER_PRODUCT("+", "*", As, W, Cs);
+ * // Matrix-vector product
+ * array y = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, 1, A.dim2);
+ * INNER_PRODUCT("+", "*", A, x, y);
  * @endcode
  */
 unsigned long long inner_product (const char *op1, const char *op2, array A,
@@ -61,5 +170,91 @@ unsigned long long inner_product (const char *op1, const char *op2, array A,
 #define INNER_PRODUCT(...)                                                    \
   _GETM_SIX (__VA_ARGS__, _INNER_PRODUCT_TWO,                                 \
              _INNER_PRODUCT_ONE) (__VA_ARGS__) /**< @copydoc inner_product*/
+/**
+ * @brief Perform structured inner product operation.
+ *
+ * Like @ref inner_product, skipping the work that the structure flags and
+ * block mask make known to be unneeded. Output flags write only a triangle
+ * of C, or compute the lower triangle of a symmetric C and mirror it. Operand
+ * flags reduce each element only over the triangle of A or B, and elements
+ * left with nothing to reduce are not written, whichever kernel runs. M
+ * splits C into as many blocks along each dimension as it has elements, and
+ * only blocks with non zero mask are written. Elements of C that are not
+ * written keep their values. Blocks and attempts to record timing if no
+ * cl_event is provided, non blocking otherwise.
+ *
+ * @param op1 String of reducing operation to perform.
+ * @param op2 String of pairwise operation to perform.
+ * @param structure Bitwise or of @ref inner_product_structure flags.
+ * @param A First argument @ref array of the kernel.
+ * @param B Second argument @ref array of the kernel.
+ * @param M Optional. @ref array of block mask of C, or NULL.
+ * @param C Third argument @ref array of the kernel.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Covariance of the columns of X, given its transpose Xt
+ * INNER_PRODUCT_STRUCTURED("+", "*", INNER_PRODUCT_SYMMETRIC, Xt, X, S);
+ * // Product of lower triangular matrices is lower triangular
+ * INNER_PRODUCT_STRUCTURED("+", "*",
+ *                          INNER_PRODUCT_LOWER | INNER_PRODUCT_A_LOWER
+ *                              | INNER_PRODUCT_B_LOWER,
+ *                          L1, L2, L);
+ * // Only the diagonal blocks of an 8x8 block matrix
+ * cl_event event;
+ * array M = ALLOC_ARRAY (char, CL_MEM_READ_ONLY, 8, 8);
+ * INNER_PRODUCT_MASKED("+", "*", 0, A, B, M, C, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long inner_product_structured (const char *op1, const char *op2,
+                                             int structure, array A, array B,
+                                             array *M, array C,
+                                             cl_event *event);
+#define _INNER_PRODUCT_STRUCTURED_ONE(op1, op2, structure, A, B, C)           \
+  inner_product_structured (op1, op2, structure, A, B, NULL, C, NULL);
+#define _INNER_PRODUCT_STRUCTURED_TWO(op1, op2, structure, A, B, C, event)    \
+  inner_product_structured (op1, op2, structure, A, B, NULL, C, event)
+#define INNER_PRODUCT_STRUCTURED(...)                                         \
+  _GETM_SEVEN (__VA_ARGS__, _INNER_PRODUCT_STRUCTURED_TWO,                    \
+               _INNER_PRODUCT_STRUCTURED_ONE) (                               \
+      __VA_ARGS__) /**< @copydoc inner_product_structured*/
+#define _INNER_PRODUCT_MASKED_ONE(op1, op2, structure, A, B, M, C)            \
+  inner_product_structured (op1, op2, structure, A, B, &(M), C, NULL);
+#define _INNER_PRODUCT_MASKED_TWO(op1, op2, structure, A, B, M, C, event)     \
+  inner_product_structured (op1, op2, structure, A, B, &(M), C, event)
+#define INNER_PRODUCT_MASKED(...)                                             \
+  _GETM_EIGHT (__VA_ARGS__, _INNER_PRODUCT_MASKED_TWO,                        \
+               _INNER_PRODUCT_MASKED_ONE) (                                   \
+      __VA_ARGS__) /**< @copydoc inner_product_structured*/
+/**
+ * @brief Perform inner product operation with a computed right operand.
+ *
+ * Like @ref inner_product_structured, reading the elements of B through the
+ * given `load_b` function of @ref get_inner_product_load, so operands such as
+ * the patches of a convolution are gathered into tiles as they are needed
+ * rather than stored. B then only provides the buffer, the dimensions passed
+ * to `load_b` and, through its third dimension, the batches. Products that
+ * read B through a loader never take the matrix-vector or @ref qgemm kernels.
+ * Blocks and attempts to record timing if no cl_event is provided, non
+ * blocking otherwise.
+ *
+ * @param op1 String of reducing operation to perform.
+ * @param op2 String of pairwise operation to perform.
+ * @param structure Bitwise or of @ref inner_product_structure flags.
+ * @param A First argument @ref array of the kernel.
+ * @param B Second argument @ref array of the kernel.
+ * @param M Optional. @ref array of block mask of C, or NULL.
+ * @param C Third argument @ref array of the kernel.
+ * @param load_b String defining `load_b`, or NULL to read B as a matrix.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ */
+unsigned long long inner_product_loader (const char *op1, const char *op2,
+                                         int structure, array A, array B,
+                                         array *M, array C,
+                                         const char *load_b, cl_event *event);
 
 #endif // INNER_PRODUCT_H_
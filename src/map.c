@@ -1,34 +1,48 @@
 #include "map.h"
 #include "cl_utils.h"
+#include "random.h"
 #include <stdio.h>
+#include <string.h>
 
 /* Format strings:
- ** 1. A type
- ** 2. B type
- ** 3. a type
- ** 4. b type
- ** 5. OP1
+ ** 1. random functions
+ ** 2. A type
+ ** 3. B type
+ ** 4. broadcast
+ ** 5. a type
+ ** 6. b type
+ ** 7. OP1
  */
-const char *_map_fmt = RAW (__kernel void entry (
+const char *_map_fmt = RAW (% s __kernel void entry (
     const int a1, const int a2, const int a3, __global const % s * A,
     const int b1, const int b2, const int b3, __global % s * B) {
-  int global_id = get_global_id (0);
-  int local_id = get_local_id (0);
-  int group_id = get_group_id (0);
+  int i = get_global_id (0);
+  int j = get_global_id (1);
+  int k = get_global_id (2);
 
-  int total = a1 * a2 * a3;
-  if (global_id < total)
+  const int broadcast = % d;
+  if (i < b1 && j < b2 && k < b3)
     {
-      % s a = A[global_id];
+      int global_id = (k * b2 + j) * b1 + i;
+      int a_id = global_id;
+      if (broadcast)
+        {
+          a_id = ((a3 == 1 ? 0 : k) * a2 + (a2 == 1 ? 0 : j)) * a1
+                 + (a1 == 1 ? 0 : i);
+        }
+      % s a = A[a_id];
       % s b = B[global_id];
       B[global_id] = % s;
     }
 });
 
 char *
-get_map (const char *atype, const char *btype, const char *op1)
+get_map (const char *atype, const char *btype, const char *op1, int broadcast)
 {
-  int size = snprintf (NULL, 0, _map_fmt, atype, btype, atype, btype, op1);
+  const char *functions = strstr (op1, "rand_") ? _philox_fmt : "";
+
+  int size = snprintf (NULL, 0, _map_fmt, functions, atype, btype, broadcast,
+                       atype, btype, op1);
 
   char *kernel = malloc (size + 1);
   if (!kernel)
@@ -36,8 +50,8 @@ get_map (const char *atype, const char *btype, const char *op1)
       handle_error ("Failed to allocate memory for kernel string");
     }
 
-  int count
-      = snprintf (kernel, size + 1, _map_fmt, atype, btype, atype, btype, op1);
+  int count = snprintf (kernel, size + 1, _map_fmt, functions, atype, btype,
+                        broadcast, atype, btype, op1);
   if (count == -1)
     {
       handle_error ("Failed to print to kernel string");
@@ -50,17 +64,31 @@ unsigned long long
 map (const char *op1, array A, array B, cl_event *event)
 {
   cl_event _event;
+  if ((A.dim1 != B.dim1 && A.dim1 != 1) || (A.dim2 != B.dim2 && A.dim2 != 1)
+      || (A.dim3 != B.dim3 && A.dim3 != 1))
+    {
+      handle_error ("Cannot broadcast array of %dx%dx%d onto %dx%dx%d",
+                    A.dim1, A.dim2, A.dim3, B.dim1, B.dim2, B.dim3);
+      return 0;
+    }
+
+  int broadcast = A.dim1 != B.dim1 || A.dim2 != B.dim2 || A.dim3 != B.dim3;
   char *src = get_map (TYPE_STR_FROM_ENUM (A.type),
-                       TYPE_STR_FROM_ENUM (B.type), op1);
+                       TYPE_STR_FROM_ENUM (B.type), op1, broadcast);
   cl_kernel kernel = TRY_COMPILE_KERNEL (src);
   free (src);
   SET_KERNEL_ARGS (kernel, A, B);
 
-  size_t local_size[] = { _tile_size, _tile_size, _tile_size };
-  size_t global_size[]
-      = { LOWEST_MULTIPLE_OF_TILE (B.dim1), LOWEST_MULTIPLE_OF_TILE (B.dim2),
-          LOWEST_MULTIPLE_OF_TILE (B.dim3) };
-  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+  // Group along the first dimension longer than 1 so work groups stay full.
+  size_t local_size[] = { 1, 1, 1 };
+  local_size[B.dim1 > 1 ? 0 : B.dim2 > 1 ? 1 : 2] = _tile_size;
+  size_t global_size[] = { B.dim1, B.dim2, B.dim3 };
+  for (int d = 0; d < 3; d++)
+    {
+      if (local_size[d] > 1)
+        global_size[d] = LOWEST_MULTIPLE_OF_TILE (global_size[d]);
+    }
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
                                     local_size, 0, NULL,
                                     event ? event : &_event));
 
@@ -18,19 +18,27 @@ extern const char *_map_fmt;
  *
  * Onto the second input argument B, the result of evaluating the operation is
  * written for each index. Variables `a` and `b` hold the values of A and B at
- * the current index respectively.
+ * the current index respectively, `i`, `j` and `k` hold the index along each
+ * dimension of B, `global_id` the index into B, and `b1`, `b2` and `b3` the
+ * dimensions of B. If broadcast is set, dimensions of A of size 1 are
+ * repeated along the same dimension of B. The random functions of @ref
+ * _philox_fmt are defined if the operation uses any of them.
  *
  * @param atype String for type of first @ref array of kernel: A.
  * @param btype String for type of second @ref array of kernel: B.
  * @param op1 String for the operation the kernel maps.
+ * @param broadcast Whether A is broadcast onto the shape of B.
  * @return Pointer to null-terminated string.
  */
-char *get_map (const char *atype, const char *btype, const char *op1);
+char *get_map (const char *atype, const char *btype, const char *op1,
+               int broadcast);
 /**
  * @brief Perform mapping operation.
  *
- * Calls mapping kernel on given input @ref array "arrays". Blocks and attempts
- * to record timing if no cl_event is provided, non blocking otherwise.
+ * Calls mapping kernel on given input @ref array "arrays". Every dimension of
+ * A must match that of B or be 1, in which case A is broadcast along it
+ * without being copied. Blocks and attempts to record timing if no cl_event is
+ * provided, non blocking otherwise.
  *
  * @param op1 String of operation to map.
  * @param A First argument @ref array of the kernel.
@@ -42,7 +50,11 @@ char *get_map (const char *atype, const char *btype, const char *op1);
  * Onto each index of the second input array is written the evaluation of the
  * input operation, within the scope of which the variables `a` and `b` exist
  * that hold the values of the first and second arrays at the current index
- * respectively.
+ * respectively. The position of the current index along each dimension of the
+ * second array is held in `i`, `j` and `k`, its flat index in `global_id`,
+ * and its dimensions in `b1`, `b2` and `b3`. Counter-based random draws are
+ * available as `rand_uniform`, `rand_normal`, `rand_int` and `rand_uint` of
+ * a seed and a draw number, see @ref fill_random.
  * @code
  * // Write the square root of each value of A into B
  * MAP("sqrt(a)", A, B);
@@ -53,6 +65,14 @@ char *get_map (const char *atype, const char *btype, const char *op1);
  * // Euclidean distance of pairs of values
  * int nanos = MAP("sqrt(pow(a, 2) + pow(b, 2))", A, B);
  * printf("Kernel took %d ms\n", nanos * 1e-6);
+ * // Add a bias row of shape (n) to each row of M of shape (n, m)
+ * MAP("a + b", bias, M);
+ * // Scale the j'th row of M by the j'th value of S of shape (1, m)
+ * MAP("a * b", S, M);
+ * // Fill a times table T of shape (n, n) by position alone
+ * MAP("(i + 1) * (j + 1)", T, T);
+ * // Inverted dropout of A into B, keeping 90% of values
+ * MAP("rand_uniform (1234, global_id) < 0.9f ? a / 0.9f : 0", A, B);
  * @endcode
  */
 unsigned long long map (const char *op1, array A, array B, cl_event *event);
@@ -1,86 +1,243 @@
 #include "outer_product.h"
 #include "cl_utils.h"
 #include <stdio.h>
+#include <string.h>
+
+/*
+** Outputs per work item along each dimension, and vector width of the loads
+** and stores of C when it has a vector form.
+*/
+#define OUTER_PRODUCT_WORK_PER_THREAD 4
 
 /* Format strings:
-** 1. A type
-** 2. B type
+** 1. C type
+** 2. C type
 ** 3. C type
-** 4. TILE_SIZE
-** 5. A_tile type
-** 6. B_tile type
-** 7. a type
-** 8. b type
-** 9. OP1
+** 4. OP2 expression
+** 5. C type
+** 6. A type
+** 7. B type
+** 8. OP1
+** 9. A type
+** 10. B type
+** 11. C type
+** 12. TILE_SIZE
+** 13. OUTER_PRODUCT_WORK_PER_THREAD
+** 14. rank
+** 15. accumulate
+** 16. vector
+** 17. A_seg type
+** 18. B_seg type
+** 19. acc type
+** 20. vector load
+** 21. value type
+** 22. vector store
+*/
+const char *_outer_product_fmt = RAW (
+    % s reduce (% s a, % s b) { return % s; }
+
+    % s apply (% s a, % s b) { return % s; }
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int b1, const int b2, const int b3, __global const % s * B,
+        const int c1, const int c2, const int c3, __global % s * C) {
+      int local_row = get_local_id (1);
+      int local_col = get_local_id (0);
+      const int tile_size = % d;
+      const int wpt = % d;
+      const int rank = % d;
+      const int accumulate = % d;
+      const int vector = % d;
+      const int block = tile_size * wpt;
+
+      // Each work group covers a block of C, loading the segments of every
+      // pair of vectors it needs once. Work items own wpt rows a tile apart
+      // and wpt consecutive columns, which are loaded and stored as vectors.
+      int row_first = get_group_id (1) * block;
+      int col_first = get_group_id (0) * block;
+      int row0 = row_first + local_row;
+      int col0 = col_first + local_col * wpt;
+      int length_A = a1 * a2 * a3 / rank;
+      int length_B = b1 * b2 * b3 / rank;
+
+      __local % s A_seg[block];
+      __local % s B_seg[block];
+      % s acc[wpt][wpt];
+      for (int i = 0; i < wpt; i++)
+        {
+          int row = row0 + i * tile_size;
+          if (vector && accumulate && row < c2 && col0 + wpt <= c1)
+            {
+              % s
+            }
+          else
+            {
+              for (int j = 0; j < wpt; j++)
+                {
+                  acc[i][j] = (accumulate && row < c2 && col0 + j < c1)
+                                  ? C[row * c1 + col0 + j]
+                                  : 0;
+                }
+            }
+        }
+
+      int id = local_row * tile_size + local_col;
+      for (int r = 0; r < rank; r++)
+        {
+          for (int e = id; e < 2 * block; e += tile_size * tile_size)
+            {
+              if (e < block)
+                {
+                  A_seg[e] = row_first + e < length_A
+                                 ? A[r * length_A + row_first + e]
+                                 : 0;
+                }
+              else
+                {
+                  B_seg[e - block]
+                      = col_first + e - block < length_B
+                            ? B[r * length_B + col_first + e - block]
+                            : 0;
+                }
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+
+          for (int i = 0; i < wpt; i++)
+            {
+              for (int j = 0; j < wpt; j++)
+                {
+                  % s value = apply (A_seg[local_row + i * tile_size],
+                                     B_seg[local_col * wpt + j]);
+                  acc[i][j] = (accumulate || r > 0)
+                                  ? reduce (acc[i][j], value)
+                                  : value;
+                }
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+
+      for (int i = 0; i < wpt; i++)
+        {
+          int row = row0 + i * tile_size;
+          if (vector && row < c2 && col0 + wpt <= c1)
+            {
+              % s
+            }
+          else
+            {
+              for (int j = 0; j < wpt && row < c2 && col0 + j < c1; j++)
+                {
+                  C[row * c1 + col0 + j] = acc[i][j];
+                }
+            }
+        }
+    });
+
+/*
+** Loads and stores of C are vectors of OUTER_PRODUCT_WORK_PER_THREAD
+** elements for types with a vector form of that width, and are done element
+** by element otherwise.
 */
-const char *_outer_product_fmt = RAW (__kernel void entry (
-    const int a1, const int a2, const int a3, __global const % s * _A,
-    const int b1, const int b2, const int b3, __global const % s * _B,
-    const int c1, const int c2, const int c3, __global % s * C) {
-  int global_row = get_global_id (1);
-  int global_col = get_global_id (0);
-
-  int local_row = get_local_id (1);
-  int local_col = get_local_id (0);
-  int row = local_row;
-  int col = local_col;
-
-  const int tile_size = % d;
-  __local % s A[tile_size];
-  __local % s B[tile_size];
-
-  A[local_row] = _A[row];
-  B[local_col] = _B[col];
-  barrier (CLK_LOCAL_MEM_FENCE);
-
-  if (global_col < c1 && global_row < c2)
+static int
+get_outer_product_vector (const char *ctype, char *load, char *store,
+                          size_t size)
+{
+  int wpt = OUTER_PRODUCT_WORK_PER_THREAD;
+  int vector = (wpt == 2 || wpt == 4 || wpt == 8 || wpt == 16)
+               && strcmp (ctype, "bool") != 0
+               && strcmp (ctype, "cfloat") != 0
+               && strcmp (ctype, "cdouble") != 0;
+
+  load[0] = '\0';
+  store[0] = '\0';
+  if (vector)
     {
-      % s a = A[local_row];
-      % s b = B[local_col];
-      C[row * c1 + col] = % s;
+      snprintf (load, size,
+                "vstore%d (vload%d (0, C + row * c1 + col0), 0, acc[i]);",
+                wpt, wpt);
+      snprintf (store, size,
+                "vstore%d (vload%d (0, acc[i]), 0, C + row * c1 + col0);",
+                wpt, wpt);
     }
-});
+
+  return vector;
+}
 
 char *
 get_outer_product (const char *atype, const char *btype, const char *ctype,
-                   const char *op1)
+                   const char *op1, const char *op2, int rank)
 {
-  int size = snprintf (NULL, 0, _outer_product_fmt, atype, btype, ctype,
-                       _tile_size, atype, btype, atype, btype, op1);
+  char load[64];
+  char store[64];
+  int vector = get_outer_product_vector (ctype, load, store, sizeof (load));
+  char *reduce = op2 ? get_op_expression (op2) : NULL;
+  if (op2 && !reduce)
+    {
+      return NULL;
+    }
+  int accumulate = op2 != NULL;
+  const char *expression = reduce ? reduce : "b";
+  int size = snprintf (NULL, 0, _outer_product_fmt, ctype, ctype, ctype,
+                       expression, ctype, atype, btype, op1, atype, btype,
+                       ctype, _tile_size, OUTER_PRODUCT_WORK_PER_THREAD, rank,
+                       accumulate, vector, atype, btype, ctype, load, ctype,
+                       store);
 
   char *kernel = malloc (size + 1);
   if (!kernel)
     {
       handle_error ("Failed to allocate memory for kernel string");
+      free (reduce);
+      return NULL;
     }
 
-  int count = snprintf (kernel, size + 1, _outer_product_fmt, atype, btype,
-                        ctype, _tile_size, atype, btype, atype, btype, op1);
+  int count = snprintf (kernel, size + 1, _outer_product_fmt, ctype, ctype,
+                        ctype, expression, ctype, atype, btype, op1, atype,
+                        btype, ctype, _tile_size,
+                        OUTER_PRODUCT_WORK_PER_THREAD, rank, accumulate,
+                        vector, atype, btype, ctype, load, ctype, store);
   if (count == -1)
     {
       handle_error ("Failed to print to kernel string");
     }
+  free (reduce);
 
   return kernel;
 }
 
 unsigned long long
-outer_product (const char *op1, array A, array B, array C, cl_event *event)
+outer_product_accumulate (const char *op1, const char *op2, array A, array B,
+                          array C, cl_event *event)
 {
   cl_event _event;
+  int rank = op2 ? A.dim2 * A.dim3 : 1;
+  if (ARRAY_SIZE (A) / rank < C.dim2 || ARRAY_SIZE (B) / rank < C.dim1
+      || (op2 && B.dim2 * B.dim3 != rank))
+    {
+      handle_error ("Outer product of %d and %d elements cannot fill %dx%d",
+                    ARRAY_SIZE (A), ARRAY_SIZE (B), C.dim1, C.dim2);
+      return 0;
+    }
+  if (_tile_size * _tile_size < 2 * OUTER_PRODUCT_WORK_PER_THREAD)
+    {
+      handle_error ("Unsupported tile size for outer product");
+      return 0;
+    }
+
   char *src = get_outer_product (TYPE_STR_FROM_ENUM (A.type),
                                  TYPE_STR_FROM_ENUM (B.type),
-                                 TYPE_STR_FROM_ENUM (C.type), op1);
+                                 TYPE_STR_FROM_ENUM (C.type), op1, op2, rank);
   cl_kernel kernel = TRY_COMPILE_KERNEL (src);
   free (src);
   SET_KERNEL_ARGS (kernel, A, B, C);
 
-  size_t local_size[] = { _tile_size, _tile_size, _tile_size };
-  size_t global_size[]
-      = { LOWEST_MULTIPLE_OF_TILE (C.dim1), LOWEST_MULTIPLE_OF_TILE (C.dim2),
-          LOWEST_MULTIPLE_OF_TILE (C.dim3) };
-  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, ARRAY_NUM_DIMS (C), NULL,
-                                    global_size, local_size, 0, NULL,
+  int block = _tile_size * OUTER_PRODUCT_WORK_PER_THREAD;
+  size_t local_size[] = { _tile_size, _tile_size };
+  size_t global_size[] = { ((C.dim1 + block - 1) / block) * _tile_size,
+                           ((C.dim2 + block - 1) / block) * _tile_size };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 2, NULL, global_size,
+                                    local_size, 0, NULL,
                                     event ? event : &_event));
 
   unsigned long long time = 0;
@@ -94,3 +251,9 @@ outer_product (const char *op1, array A, array B, array C, cl_event *event)
 
   return time;
 }
+
+unsigned long long
+outer_product (const char *op1, array A, array B, array C, cl_event *event)
+{
+  return outer_product_accumulate (op1, NULL, A, B, C, event);
+}
@@ -18,20 +18,27 @@ extern const char *_outer_product_fmt;
  *
  * Onto the third input argument C, the result of evaluating the operation is
  * written for each index. Variables `a` and `b` hold the values of A and B at
- * the current row index and column index respectively.
+ * the current row index and column index respectively. A and B are split
+ * into rank pairs of vectors whose results are reduced by op2, starting from
+ * the current value of C, or written directly if op2 is NULL. Each work item
+ * computes several outputs of a block of C and stores them as vectors.
  *
  * @param atype String for type of first @ref array of kernel: A.
  * @param btype String for type of second @ref array of kernel: B.
  * @param ctype String for type of third @ref array of kernel: C.
  * @param op1 String for the operation the kernel performs.
+ * @param op2 String for the accumulating operation, or NULL.
+ * @param rank Number of pairs of vectors in A and B.
  * @return Pointer to null-terminated string.
  */
 char *get_outer_product (const char *atype, const char *btype,
-                         const char *ctype, const char *op1);
+                         const char *ctype, const char *op1, const char *op2,
+                         int rank);
 /**
  * @brief Perform outer product operation.
  *
- * Calls outer product kernel on given input @ref array "arrays". Blocks and
+ * Calls outer product kernel on given input @ref array "arrays", where A holds
+ * at least as many elements as C has rows and B as C has columns. Blocks and
  * attempts to record timing if no cl_event is provided, non blocking
  * otherwise.
  *
@@ -65,5 +72,41 @@ unsigned long long outer_product (const char *op1, array A, array B, array C,
 #define OUTER_PRODUCT(...)                                                    \
   _GETM_FIVE (__VA_ARGS__, _OUTER_PRODUCT_TWO,                                \
               _OUTER_PRODUCT_ONE) (__VA_ARGS__) /**< @copydoc outer_product*/
+/**
+ * @brief Perform rank-k accumulating outer product operation.
+ *
+ * Accumulates onto C the outer products of each row of A with the same row
+ * of B, so that `C = op2 (C, op1 (a, b))` for every pair of rows in turn.
+ * Rows of A are at least as long as C has rows, and rows of B as C has
+ * columns. op2 is a binary operator, or the name of a function of two
+ * arguments such as max. Blocks and attempts to record timing if no cl_event
+ * is provided, non blocking otherwise.
+ *
+ * @param op1 String of operation to perform.
+ * @param op2 String of accumulating operation.
+ * @param A First argument @ref array of the kernel.
+ * @param B Second argument @ref array of the kernel.
+ * @param C Third argument @ref array of the kernel.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Rank-k update C += U * V^T with U of (m, k) and V of (n, k), given the
+ * // transposes Ut and Vt
+ * OUTER_PRODUCT_ACCUMULATE("a * b", "+", Ut, Vt, C);
+ * @endcode
+ */
+unsigned long long outer_product_accumulate (const char *op1, const char *op2,
+                                             array A, array B, array C,
+                                             cl_event *event);
+#define _OUTER_PRODUCT_ACCUMULATE_ONE(op1, op2, A, B, C)                      \
+  outer_product_accumulate (op1, op2, A, B, C, NULL);
+#define _OUTER_PRODUCT_ACCUMULATE_TWO(op1, op2, A, B, C, event)               \
+  outer_product_accumulate (op1, op2, A, B, C, event)
+#define OUTER_PRODUCT_ACCUMULATE(...)                                         \
+  _GETM_SIX (__VA_ARGS__, _OUTER_PRODUCT_ACCUMULATE_TWO,                      \
+             _OUTER_PRODUCT_ACCUMULATE_ONE) (                                 \
+      __VA_ARGS__) /**< @copydoc outer_product_accumulate*/
 
 #endif // OUTER_PRODUCT_H_
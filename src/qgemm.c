@@ -0,0 +1,276 @@
+#include "qgemm.h"
+#include "cl_utils.h"
+#include "gemm.h"
+#include <stdio.h>
+
+/* Format strings:
+** 1. A type
+** 2. B type
+** 3. C type
+** 4. TILE_SIZE
+** 5. GEMM_WORK_PER_THREAD
+** 6. has_za
+** 7. has_zb
+** 8. has_sa
+** 9. has_sb
+** 10. A_tile type
+** 11. B_tile type
+** 12. a type
+** 13. b type
+** 14. out type
+*/
+const char *_qgemm_fmt = RAW (__kernel void entry (
+    const int a1, const int a2, const int a3, __global const % s * A,
+    const int b1, const int b2, const int b3, __global const % s * B,
+    const int c1, const int c2, const int c3, __global % s * C,
+    const int sa1, const int sa2, const int sa3, __global const float *SA,
+    const int za1, const int za2, const int za3, __global const int *ZA,
+    const int sb1, const int sb2, const int sb3, __global const float *SB,
+    const int zb1, const int zb2, const int zb3, __global const int *ZB) {
+  int local_row = get_local_id (1);
+  int local_col = get_local_id (0);
+  int batch = get_global_id (2);
+  const int tile_size = % d;
+  const int wpt = % d;
+  const int has_za = % d;
+  const int has_zb = % d;
+  const int has_sa = % d;
+  const int has_sb = % d;
+
+  // Operands with a single matrix are shared by every batch.
+  A += (a3 > 1) * batch * a1 * a2;
+  B += (b3 > 1) * batch * b1 * b2;
+  C += batch * c1 * c2;
+  const int block = tile_size * wpt;
+  const int stride = block + 1;
+
+  // Tiles stay 8 bit in local memory and widen to int in registers, where
+  // row and column sums are kept alongside for the zero point correction.
+  __local % s A_tile[2 * tile_size * stride];
+  __local % s B_tile[2 * tile_size * stride];
+  int acc[wpt][wpt];
+  int sum_a[wpt];
+  int sum_b[wpt];
+  for (int i = 0; i < wpt; i++)
+    {
+      sum_a[i] = 0;
+      sum_b[i] = 0;
+      for (int j = 0; j < wpt; j++)
+        {
+          acc[i][j] = 0;
+        }
+    }
+
+  int id = local_row * tile_size + local_col;
+  int load_row = id / (tile_size / wpt);
+  int load_k = (id - load_row * (tile_size / wpt)) * wpt;
+  int load_b_k = id / tile_size;
+  int load_col = (id - load_b_k * tile_size) * wpt;
+  int row_A = get_group_id (1) * block + load_row;
+  int col_B = get_group_id (0) * block + load_col;
+
+  int tiles = (a1 + tile_size - 1) / tile_size;
+  for (int t = -1; t < tiles; t++)
+    {
+      if (t + 1 < tiles)
+        {
+          int buf = ((t + 1) & 1) * tile_size * stride;
+          % s a[wpt];
+          % s b[wpt];
+          int k = (t + 1) * tile_size + load_k;
+          if (row_A < a2 && k + wpt <= a1)
+            {
+              vstore4 (vload4 (0, A + row_A * a1 + k), 0, a);
+            }
+          else
+            {
+              for (int c = 0; c < wpt; c++)
+                {
+                  a[c] = (row_A < a2 && k + c < a1) ? A[row_A * a1 + k + c]
+                                                     : 0;
+                }
+            }
+          k = (t + 1) * tile_size + load_b_k;
+          if (k < b2 && col_B + wpt <= b1)
+            {
+              vstore4 (vload4 (0, B + k * b1 + col_B), 0, b);
+            }
+          else
+            {
+              for (int c = 0; c < wpt; c++)
+                {
+                  b[c] = (k < b2 && col_B + c < b1) ? B[k * b1 + col_B + c]
+                                                     : 0;
+                }
+            }
+          for (int c = 0; c < wpt; c++)
+            {
+              A_tile[buf + (load_k + c) * stride + load_row] = a[c];
+              B_tile[buf + load_b_k * stride + load_col + c] = b[c];
+            }
+        }
+
+      if (t >= 0)
+        {
+          int buf = (t & 1) * tile_size * stride;
+          for (int k = 0; k < tile_size; k++)
+            {
+              int a_reg[wpt];
+              int b_reg[wpt];
+              for (int i = 0; i < wpt; i++)
+                {
+                  a_reg[i] = A_tile[buf + k * stride + local_row
+                                    + i * tile_size];
+                  b_reg[i] = B_tile[buf + k * stride + local_col
+                                    + i * tile_size];
+                  sum_a[i] += a_reg[i];
+                  sum_b[i] += b_reg[i];
+                }
+              for (int i = 0; i < wpt; i++)
+                {
+                  for (int j = 0; j < wpt; j++)
+                    {
+                      acc[i][j] += a_reg[i] * b_reg[j];
+                    }
+                }
+            }
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+    }
+
+  // Expands sum (a - za) * (b - zb) from the plain products and the sums.
+  int row0 = get_group_id (1) * block + local_row;
+  int col0 = get_group_id (0) * block + local_col;
+  for (int i = 0; i < wpt; i++)
+    {
+      int row = row0 + i * tile_size;
+      if (row >= c2)
+        {
+          break;
+        }
+      int za = has_za ? ZA[za1 * za2 * za3 > 1 ? row : 0] : 0;
+      float sa = has_sa ? SA[sa1 * sa2 * sa3 > 1 ? row : 0] : 1;
+      for (int j = 0; j < wpt; j++)
+        {
+          int col = col0 + j * tile_size;
+          if (col < c1)
+            {
+              int zb = has_zb ? ZB[zb1 * zb2 * zb3 > 1 ? col : 0] : 0;
+              float sb = has_sb ? SB[sb1 * sb2 * sb3 > 1 ? col : 0] : 1;
+              int r = acc[i][j] - zb * sum_a[i] - za * sum_b[j]
+                      + a1 * za * zb;
+              % s out = r;
+              if (has_sa || has_sb)
+                {
+                  out = r * sa * sb;
+                }
+              C[row * c1 + col] = out;
+            }
+        }
+    }
+});
+
+char *
+get_qgemm (const char *ctype, int has_za, int has_zb, int has_sa, int has_sb)
+{
+  int size = snprintf (NULL, 0, _qgemm_fmt, "char", "char", ctype, _tile_size,
+                       GEMM_WORK_PER_THREAD, has_za, has_zb, has_sa, has_sb,
+                       "char", "char", "char", "char", ctype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _qgemm_fmt, "char", "char", ctype,
+                        _tile_size, GEMM_WORK_PER_THREAD, has_za, has_zb,
+                        has_sa, has_sb, "char", "char", "char", "char", ctype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+static int
+qgemm_check_epilogue (array *V, array_type type, int length, const char *what)
+{
+  if (!V)
+    return 1;
+  if (V->type != type)
+    {
+      handle_error ("Quantized product %s must be an array of %s", what,
+                    TYPE_STR_FROM_ENUM (type));
+      return 0;
+    }
+  if (ARRAY_SIZE ((*V)) != 1 && ARRAY_SIZE ((*V)) != length)
+    {
+      handle_error ("Quantized product %s of %d elements, expected 1 or %d",
+                    what, ARRAY_SIZE ((*V)), length);
+      return 0;
+    }
+  return 1;
+}
+
+unsigned long long
+qgemm (array A, array *SA, array *ZA, array B, array *SB, array *ZB, array C,
+       cl_event *event)
+{
+  cl_event _event;
+  if (A.type != TYPE_CHAR || B.type != TYPE_CHAR
+      || (C.type != TYPE_INT && C.type != TYPE_FLOAT))
+    {
+      handle_error ("Quantized product needs char operands into int or float");
+      return 0;
+    }
+  if (_tile_size % GEMM_WORK_PER_THREAD != 0)
+    {
+      handle_error ("Unsupported tile size for matrix product");
+      return 0;
+    }
+  if ((A.dim3 != C.dim3 && A.dim3 != 1) || (B.dim3 != C.dim3 && B.dim3 != 1))
+    {
+      handle_error ("Cannot batch %d and %d matrices into %d", A.dim3, B.dim3,
+                    C.dim3);
+      return 0;
+    }
+  if ((SA || SB) && C.type != TYPE_FLOAT)
+    {
+      handle_error ("Scaled quantized product must be written to float");
+      return 0;
+    }
+  if (!qgemm_check_epilogue (SA, TYPE_FLOAT, C.dim2, "row scales")
+      || !qgemm_check_epilogue (ZA, TYPE_INT, C.dim2, "row zero points")
+      || !qgemm_check_epilogue (SB, TYPE_FLOAT, C.dim1, "column scales")
+      || !qgemm_check_epilogue (ZB, TYPE_INT, C.dim1, "column zero points"))
+    return 0;
+
+  char *src = get_qgemm (TYPE_STR_FROM_ENUM (C.type), ZA != NULL, ZB != NULL,
+                         SA != NULL, SB != NULL);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  set_kernel_args (kernel, 7, A, B, C, SA ? *SA : C, ZA ? *ZA : C,
+                   SB ? *SB : C, ZB ? *ZB : C);
+
+  int block = _tile_size * GEMM_WORK_PER_THREAD;
+  size_t local_size[] = { _tile_size, _tile_size, 1 };
+  size_t global_size[] = { ((C.dim1 + block - 1) / block) * _tile_size,
+                           ((C.dim2 + block - 1) / block) * _tile_size,
+                           C.dim3 };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    event ? event : &_event));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file qgemm.h
+ */
+
+#ifndef QGEMM_H_
+#define QGEMM_H_
+
+#include "cl_utils.h"
+
+extern const char *_qgemm_fmt;
+/**
+ * @brief Composes quantized matrix multiplication kernel.
+ *
+ * Constructs the kernel with the specified type and epilogue, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the third input argument C, the matrix product of the char arrays A
+ * and B is written, accumulated in int by the register blocked scheme of
+ * @ref get_gemm. Zero points of the rows of A and columns of B are
+ * subtracted from the operands, and the result is multiplied by their
+ * scales, if the corresponding flags are set.
+ *
+ * @param ctype String for type of third @ref array of kernel: C.
+ * @param has_za Whether zero points of the rows of A are given.
+ * @param has_zb Whether zero points of the columns of B are given.
+ * @param has_sa Whether scales of the rows of A are given.
+ * @param has_sb Whether scales of the columns of B are given.
+ * @return Pointer to null-terminated string.
+ */
+char *get_qgemm (const char *ctype, int has_za, int has_zb, int has_sa,
+                 int has_sb);
+/**
+ * @brief Perform quantized matrix multiplication.
+ *
+ * Writes into C the product of the char matrices A and B, computed as
+ * `sum (A - ZA) * (B - ZB)` with int accumulation and scaled by `SA * SB`.
+ * ZA and SA hold the int zero point and float scale of each row of A, and ZB
+ * and SB those of each column of B, or a single element shared by every row
+ * or column. Any of them may be NULL to leave that zero point out or that
+ * scale at one. C is int, or float when scales are given. Batches along the
+ * third dimension are multiplied as in @ref gemm, sharing the zero points and
+ * scales. Blocks and attempts to record timing if no cl_event is provided,
+ * non blocking otherwise.
+ *
+ * @param A First argument @ref array of the kernel, of char.
+ * @param SA Optional. @ref array of float scales of rows of A, or NULL.
+ * @param ZA Optional. @ref array of int zero points of rows of A, or NULL.
+ * @param B Second argument @ref array of the kernel, of char.
+ * @param SB Optional. @ref array of float scales of columns of B, or NULL.
+ * @param ZB Optional. @ref array of int zero points of columns of B, or NULL.
+ * @param C @ref array of int or float to write the product into.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Exact int products of int8 matrices
+ * array C = ALLOC_ARRAY (int, CL_MEM_READ_WRITE, B.dim1, A.dim2);
+ * QGEMM(A, B, C);
+ * // Dequantized activations times per channel quantized weights
+ * cl_event event;
+ * array Y = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, W.dim1, X.dim2);
+ * QGEMM_SCALED(X, x_scale, x_zero, W, w_scales, w_zeros, Y, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long qgemm (array A, array *SA, array *ZA, array B, array *SB,
+                          array *ZB, array C, cl_event *event);
+#define _QGEMM_ONE(A, B, C) qgemm (A, NULL, NULL, B, NULL, NULL, C, NULL);
+#define _QGEMM_TWO(A, B, C, event)                                            \
+  qgemm (A, NULL, NULL, B, NULL, NULL, C, event)
+#define QGEMM(...)                                                            \
+  _GETM_FOUR (__VA_ARGS__, _QGEMM_TWO, _QGEMM_ONE) (                          \
+      __VA_ARGS__) /**< @copydoc qgemm*/
+#define _QGEMM_SCALED_ONE(A, SA, ZA, B, SB, ZB, C)                            \
+  qgemm (A, &(SA), &(ZA), B, &(SB), &(ZB), C, NULL);
+#define _QGEMM_SCALED_TWO(A, SA, ZA, B, SB, ZB, C, event)                     \
+  qgemm (A, &(SA), &(ZA), B, &(SB), &(ZB), C, event)
+#define QGEMM_SCALED(...)                                                     \
+  _GETM_EIGHT (__VA_ARGS__, _QGEMM_SCALED_TWO,                                \
+               _QGEMM_SCALED_ONE) (__VA_ARGS__) /**< @copydoc qgemm*/
+
+#endif // QGEMM_H_
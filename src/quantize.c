@@ -0,0 +1,200 @@
+#include "quantize.h"
+#include "cl_utils.h"
+#include <stdio.h>
+
+/* Format strings:
+** 1. A type
+** 2. S type
+** 3. Z type
+** 4. Q type
+** 5. axis
+** 6. has_zero_points
+*/
+const char *_quantize_fmt = RAW (__kernel void entry (
+    const int a1, const int a2, const int a3, __global const % s * A,
+    const int s1, const int s2, const int s3, __global const % s * S,
+    const int z1, const int z2, const int z3, __global const % s * Z,
+    const int q1, const int q2, const int q3, __global % s * Q) {
+  int i = get_global_id (0);
+  int j = get_global_id (1);
+  int k = get_global_id (2);
+  const int axis = % d;
+  const int has_zero_points = % d;
+
+  if (i < a1)
+    {
+      int c = axis == 0 ? i : axis == 1 ? j : k;
+      int id = (k * a2 + j) * a1 + i;
+      float s = S[s1 * s2 * s3 > 1 ? c : 0];
+      int z = has_zero_points ? Z[z1 * z2 * z3 > 1 ? c : 0] : 0;
+      Q[id] = convert_char_sat (rint (A[id] / s) + z);
+    }
+});
+
+/* Format strings:
+** 1. Q type
+** 2. S type
+** 3. Z type
+** 4. A type
+** 5. axis
+** 6. has_zero_points
+*/
+const char *_dequantize_fmt = RAW (__kernel void entry (
+    const int q1, const int q2, const int q3, __global const % s * Q,
+    const int s1, const int s2, const int s3, __global const % s * S,
+    const int z1, const int z2, const int z3, __global const % s * Z,
+    const int a1, const int a2, const int a3, __global % s * A) {
+  int i = get_global_id (0);
+  int j = get_global_id (1);
+  int k = get_global_id (2);
+  const int axis = % d;
+  const int has_zero_points = % d;
+
+  if (i < a1)
+    {
+      int c = axis == 0 ? i : axis == 1 ? j : k;
+      int id = (k * a2 + j) * a1 + i;
+      int z = has_zero_points ? Z[z1 * z2 * z3 > 1 ? c : 0] : 0;
+      A[id] = (Q[id] - z) * S[s1 * s2 * s3 > 1 ? c : 0];
+    }
+});
+
+char *
+get_quantize (const char *atype, const char *stype, const char *ztype,
+              const char *qtype, int axis, int has_zero_points)
+{
+  int size = snprintf (NULL, 0, _quantize_fmt, atype, stype, ztype, qtype,
+                       axis, has_zero_points);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _quantize_fmt, atype, stype, ztype,
+                        qtype, axis, has_zero_points);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+char *
+get_dequantize (const char *qtype, const char *stype, const char *ztype,
+                const char *atype, int axis, int has_zero_points)
+{
+  int size = snprintf (NULL, 0, _dequantize_fmt, qtype, stype, ztype, atype,
+                       axis, has_zero_points);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _dequantize_fmt, qtype, stype,
+                        ztype, atype, axis, has_zero_points);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+/*
+** Scales and zero points hold a single element for the whole array, or one
+** per index along the quantization axis.
+*/
+static int
+quantize_check (int axis, array X, array S, array *Z, array Q)
+{
+  int dims[] = { X.dim1, X.dim2, X.dim3 };
+  if (axis < 0 || axis > 2)
+    {
+      handle_error ("Quantization axis must be 0, 1 or 2, got %d", axis);
+      return 0;
+    }
+  if (ARRAY_SIZE (X) != ARRAY_SIZE (Q) || Q.type != TYPE_CHAR)
+    {
+      handle_error ("Quantized array must be of char and as large as input");
+      return 0;
+    }
+  if ((ARRAY_SIZE (S) != 1 && ARRAY_SIZE (S) != dims[axis])
+      || (Z && ARRAY_SIZE ((*Z)) != 1 && ARRAY_SIZE ((*Z)) != dims[axis]))
+    {
+      handle_error ("Scales and zero points need 1 or %d elements",
+                    dims[axis]);
+      return 0;
+    }
+  return 1;
+}
+
+unsigned long long
+quantize (int axis, array A, array S, array *Z, array Q, cl_event *event)
+{
+  cl_event _event;
+  if (!quantize_check (axis, A, S, Z, Q))
+    return 0;
+
+  char *src = get_quantize (TYPE_STR_FROM_ENUM (A.type),
+                            TYPE_STR_FROM_ENUM (S.type),
+                            TYPE_STR_FROM_ENUM (Z ? Z->type : S.type),
+                            TYPE_STR_FROM_ENUM (Q.type), axis, Z != NULL);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  set_kernel_args (kernel, 4, A, S, Z ? *Z : S, Q);
+
+  size_t local_size[] = { _tile_size, 1, 1 };
+  size_t global_size[] = { LOWEST_MULTIPLE_OF_TILE (A.dim1), A.dim2, A.dim3 };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    event ? event : &_event));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
+
+unsigned long long
+dequantize (int axis, array Q, array S, array *Z, array A, cl_event *event)
+{
+  cl_event _event;
+  if (!quantize_check (axis, A, S, Z, Q))
+    return 0;
+
+  char *src = get_dequantize (TYPE_STR_FROM_ENUM (Q.type),
+                              TYPE_STR_FROM_ENUM (S.type),
+                              TYPE_STR_FROM_ENUM (Z ? Z->type : S.type),
+                              TYPE_STR_FROM_ENUM (A.type), axis, Z != NULL);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  set_kernel_args (kernel, 4, Q, S, Z ? *Z : S, A);
+
+  size_t local_size[] = { _tile_size, 1, 1 };
+  size_t global_size[] = { LOWEST_MULTIPLE_OF_TILE (A.dim1), A.dim2, A.dim3 };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    event ? event : &_event));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file quantize.h
+ */
+
+#ifndef QUANTIZE_H_
+#define QUANTIZE_H_
+
+#include "cl_utils.h"
+
+extern const char *_quantize_fmt;
+extern const char *_dequantize_fmt;
+/**
+ * @brief Composes quantize kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the fourth input argument Q, writes each element of A divided by its
+ * scale in S, rounded to nearest and offset by its zero point in Z if
+ * has_zero_points is set, saturated to char. Scales and zero points are
+ * indexed along the given axis, or shared when they hold a single element.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param stype String for type of second @ref array of kernel: S.
+ * @param ztype String for type of third @ref array of kernel: Z.
+ * @param qtype String for type of fourth @ref array of kernel: Q.
+ * @param axis Dimension indexing scales and zero points, from 0 to 2.
+ * @param has_zero_points Whether elements are offset by Z.
+ * @return Pointer to null-terminated string.
+ */
+char *get_quantize (const char *atype, const char *stype, const char *ztype,
+                    const char *qtype, int axis, int has_zero_points);
+/**
+ * @brief Composes dequantize kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the fourth input argument A, writes each element of Q less its zero
+ * point in Z if has_zero_points is set, multiplied by its scale in S, indexed
+ * as in @ref get_quantize.
+ *
+ * @param qtype String for type of first @ref array of kernel: Q.
+ * @param stype String for type of second @ref array of kernel: S.
+ * @param ztype String for type of third @ref array of kernel: Z.
+ * @param atype String for type of fourth @ref array of kernel: A.
+ * @param axis Dimension indexing scales and zero points, from 0 to 2.
+ * @param has_zero_points Whether elements are offset by Z.
+ * @return Pointer to null-terminated string.
+ */
+char *get_dequantize (const char *qtype, const char *stype, const char *ztype,
+                      const char *atype, int axis, int has_zero_points);
+/**
+ * @brief Perform quantize operation.
+ *
+ * Writes `Q = round (A / S) + Z` saturated to the range of char, where S and
+ * Z hold one scale and zero point per index of A along axis, or a single
+ * element for all of A. Z may be NULL for symmetric quantization. Blocks and
+ * attempts to record timing if no cl_event is provided, non blocking
+ * otherwise.
+ *
+ * @param axis Dimension of A along which scales and zero points vary.
+ * @param A @ref array to quantize.
+ * @param S @ref array of scales.
+ * @param Z Optional. @ref array of int zero points, or NULL.
+ * @param Q @ref array of char to write into, as large as A.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Per tensor asymmetric quantization of activations
+ * array q = ALLOC_ARRAY (char, CL_MEM_READ_WRITE, X.dim1, X.dim2);
+ * QUANTIZE(0, X, x_scale, x_zero, q);
+ * // Per column symmetric quantization of weights
+ * cl_event event;
+ * QUANTIZE_SYMMETRIC(0, W, w_scales, qw, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long quantize (int axis, array A, array S, array *Z, array Q,
+                             cl_event *event);
+#define _QUANTIZE_ONE(axis, A, S, Z, Q) quantize (axis, A, S, &(Z), Q, NULL);
+#define _QUANTIZE_TWO(axis, A, S, Z, Q, event)                                \
+  quantize (axis, A, S, &(Z), Q, event)
+#define QUANTIZE(...)                                                         \
+  _GETM_SIX (__VA_ARGS__, _QUANTIZE_TWO, _QUANTIZE_ONE) (                     \
+      __VA_ARGS__) /**< @copydoc quantize*/
+#define _QUANTIZE_SYMMETRIC_ONE(axis, A, S, Q)                                \
+  quantize (axis, A, S, NULL, Q, NULL);
+#define _QUANTIZE_SYMMETRIC_TWO(axis, A, S, Q, event)                         \
+  quantize (axis, A, S, NULL, Q, event)
+#define QUANTIZE_SYMMETRIC(...)                                               \
+  _GETM_FIVE (__VA_ARGS__, _QUANTIZE_SYMMETRIC_TWO,                           \
+              _QUANTIZE_SYMMETRIC_ONE) (__VA_ARGS__) /**< @copydoc quantize*/
+/**
+ * @brief Perform dequantize operation.
+ *
+ * Writes `A = (Q - Z) * S`, the inverse of @ref quantize up to rounding, with
+ * scales and zero points given in the same way. Blocks and attempts to record
+ * timing if no cl_event is provided, non blocking otherwise.
+ *
+ * @param axis Dimension of Q along which scales and zero points vary.
+ * @param Q @ref array of char to dequantize.
+ * @param S @ref array of scales.
+ * @param Z Optional. @ref array of int zero points, or NULL.
+ * @param A @ref array to write into, as large as Q.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * array X = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, q.dim1, q.dim2);
+ * DEQUANTIZE(0, q, x_scale, x_zero, X);
+ * @endcode
+ */
+unsigned long long dequantize (int axis, array Q, array S, array *Z, array A,
+                               cl_event *event);
+#define _DEQUANTIZE_ONE(axis, Q, S, Z, A)                                     \
+  dequantize (axis, Q, S, &(Z), A, NULL);
+#define _DEQUANTIZE_TWO(axis, Q, S, Z, A, event)                              \
+  dequantize (axis, Q, S, &(Z), A, event)
+#define DEQUANTIZE(...)                                                       \
+  _GETM_SIX (__VA_ARGS__, _DEQUANTIZE_TWO, _DEQUANTIZE_ONE) (                 \
+      __VA_ARGS__) /**< @copydoc dequantize*/
+#define _DEQUANTIZE_SYMMETRIC_ONE(axis, Q, S, A)                              \
+  dequantize (axis, Q, S, NULL, A, NULL);
+#define _DEQUANTIZE_SYMMETRIC_TWO(axis, Q, S, A, event)                       \
+  dequantize (axis, Q, S, NULL, A, event)
+#define DEQUANTIZE_SYMMETRIC(...)                                             \
+  _GETM_FIVE (__VA_ARGS__, _DEQUANTIZE_SYMMETRIC_TWO,                         \
+              _DEQUANTIZE_SYMMETRIC_ONE) (                                    \
+      __VA_ARGS__) /**< @copydoc dequantize*/
+
+#endif // QUANTIZE_H_
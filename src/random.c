@@ -0,0 +1,220 @@
+#include "random.h"
+#include "cl_utils.h"
+#include <stdio.h>
+
+/*
+** Kernel functions without format strings, so they can be printed into
+** other kernels as they are.
+*/
+const char *_philox_fmt = RAW (
+    void philox4x32 (ulong counter, ulong key, uint *c) {
+      uint k0 = (uint)key;
+      uint k1 = (uint)(key >> 32);
+      c[0] = (uint)counter;
+      c[1] = (uint)(counter >> 32);
+      c[2] = 0;
+      c[3] = 0;
+      for (int r = 0; r < 10; r++)
+        {
+          uint hi0 = mul_hi (0xD2511F53u, c[0]);
+          uint lo0 = 0xD2511F53u * c[0];
+          uint hi1 = mul_hi (0xCD9E8D57u, c[2]);
+          uint lo1 = 0xCD9E8D57u * c[2];
+          c[0] = hi1 ^ c[1] ^ k0;
+          c[1] = lo1;
+          c[2] = hi0 ^ c[3] ^ k1;
+          c[3] = lo0;
+          k0 += 0x9E3779B9u;
+          k1 += 0xBB67AE85u;
+        }
+    }
+
+    float philox_unit (uint x) { return (x >> 8) * 0x1p-24f; }
+
+    float philox_normal (uint x, uint y, int second) {
+      float r = sqrt (-2 * log ((x + 0.5f) * 0x1p-32f));
+      float t = 6.28318531f * philox_unit (y);
+      return r * (second ? sin (t) : cos (t));
+    }
+
+    uint rand_uint (ulong seed, ulong counter) {
+      uint c[4];
+      philox4x32 (counter / 4, seed, c);
+      return c[counter & 3];
+    }
+
+    float rand_uniform (ulong seed, ulong counter) {
+      return philox_unit (rand_uint (seed, counter));
+    }
+
+    float rand_normal (ulong seed, ulong counter) {
+      uint c[4];
+      philox4x32 (counter / 4, seed, c);
+      int w = counter & 3;
+      return philox_normal (c[w & 2], c[w | 1], w & 1);
+    }
+
+    int rand_int (ulong seed, ulong counter, int lo, int hi) {
+      ulong range = (uint)(hi - lo);
+      return lo + (int)((rand_uint (seed, counter) * range) >> 32);
+    });
+
+/*
+** Double precision functions, only defined for double elements so devices
+** without fp64 still compile the others.
+*/
+const char *_philox_double_fmt = RAW (
+    double philox_unit_double (uint x) { return x * 0x1p-32; }
+
+    double philox_normal_double (uint x, uint y, int second) {
+      double r = sqrt (-2 * log ((x + 0.5) * 0x1p-32));
+      double t = 6.283185307179586 * philox_unit_double (y);
+      return r * (second ? sin (t) : cos (t));
+    });
+
+/* Format strings:
+** 1. philox functions
+** 2. double precision functions
+** 3. A type
+** 4. parameter type
+** 5. parameter type
+** 6. OP1
+*/
+const char *_random_fmt = RAW (
+    % s % s
+
+    __kernel void entry (const int a1, const int a2, const int a3,
+                         __global % s * A, const ulong seed,
+                         const ulong offset, const % s p1, const % s p2) {
+      ulong block = offset / 4 + get_global_id (0);
+      ulong total = (ulong)a1 * a2 * a3;
+      uint c[4];
+      philox4x32 (block, seed, c);
+      for (int w = 0; w < 4; w++)
+        {
+          ulong n = block * 4 + w - offset;
+          if (block * 4 + w >= offset && n < total)
+            {
+              A[n] = % s;
+            }
+        }
+    });
+
+char *
+get_random (const char *atype, const char *ptype, const char *op1,
+            int has_double)
+{
+  const char *double_functions = has_double ? _philox_double_fmt : "";
+
+  int size = snprintf (NULL, 0, _random_fmt, _philox_fmt, double_functions,
+                       atype, ptype, ptype, op1);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _random_fmt, _philox_fmt,
+                        double_functions, atype, ptype, ptype, op1);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+/*
+** Integer draws take the high word of the product of a draw and the range,
+** so p2 holds the range rather than the upper bound.
+*/
+unsigned long long
+fill_random (random_distribution dist, double p1, double p2, cl_ulong seed,
+             cl_ulong offset, array A, cl_event *event)
+{
+  int has_double = A.type == TYPE_DOUBLE;
+  const char *op1;
+  switch (dist)
+    {
+    case RANDOM_UNIFORM:
+      op1 = has_double ? "p1 + (p2 - p1) * philox_unit_double (c[w])"
+                       : "p1 + (p2 - p1) * philox_unit (c[w])";
+      break;
+    case RANDOM_NORMAL:
+      op1 = has_double ? "p1 + p2 * philox_normal_double (c[w & 2], "
+                         "c[w | 1], w & 1)"
+                       : "p1 + p2 * philox_normal (c[w & 2], c[w | 1], "
+                         "w & 1)";
+      break;
+    case RANDOM_INTEGER:
+      op1 = "p1 + (long)(((ulong)c[w] * p2) >> 32)";
+      break;
+    default:
+      handle_error ("Unknown random distribution %d", dist);
+      return 0;
+    }
+
+  if (A.type == TYPE_CFLOAT || A.type == TYPE_CDOUBLE
+      || A.type == TYPE_UNKNOWN
+      || (dist != RANDOM_INTEGER && A.type != TYPE_FLOAT && !has_double))
+    {
+      handle_error ("Unimplemented random type %s, use %s",
+                    TYPE_STR_FROM_ENUM (A.type),
+                    dist == RANDOM_INTEGER ? "a real type"
+                                           : "float or double");
+      return 0;
+    }
+  if (dist == RANDOM_INTEGER && (p2 <= p1 || p2 - p1 > 4294967296.0))
+    {
+      handle_error ("Cannot draw integers from [%g, %g)", p1, p2);
+      return 0;
+    }
+
+  const char *ptype = dist == RANDOM_INTEGER ? "long"
+                      : has_double           ? "double"
+                                             : "float";
+  char *src = get_random (TYPE_STR_FROM_ENUM (A.type), ptype, op1, has_double);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  int idx = SET_KERNEL_ARGS (kernel, A);
+  CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (cl_ulong), &seed));
+  CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (cl_ulong), &offset));
+  if (dist == RANDOM_INTEGER)
+    {
+      cl_long lo = p1;
+      cl_long range = p2 - p1;
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (cl_long), &lo));
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (cl_long), &range));
+    }
+  else if (has_double)
+    {
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (double), &p1));
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (double), &p2));
+    }
+  else
+    {
+      float fp1 = p1;
+      float fp2 = p2;
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (float), &fp1));
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (float), &fp2));
+    }
+
+  cl_event partial;
+  size_t blocks = ((offset & 3) + ARRAY_SIZE (A) + 3) / 4;
+  size_t local_size[] = { _tile_size };
+  size_t global_size[] = { LOWEST_MULTIPLE_OF_TILE (blocks) };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+                                    local_size, 0, NULL, &partial));
+
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (clEnqueueMarkerWithWaitList (_queue, 1, &partial, event));
+      return 0;
+    }
+
+  return GET_CL_EVENT_TIME (partial);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file random.h
+ */
+
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include "cl_utils.h"
+
+/**
+ * @brief Enum representing distributions of random @ref array elements.
+ */
+typedef enum
+{
+  RANDOM_UNIFORM, /**< Real values uniform in `[lo, hi)`. */
+  RANDOM_NORMAL,  /**< Real values normal of given mean and deviation. */
+  RANDOM_INTEGER, /**< Integers uniform in `[lo, hi)`. */
+} random_distribution;
+
+/**
+ * @brief Philox4x32-10 kernel functions.
+ *
+ * Defines `philox4x32 (counter, key, c)`, writing into the four uint c the
+ * block of the given ulong counter and key, and functions of single draws of
+ * the stream given by a ulong seed, numbered by a ulong counter:
+ * `rand_uint (seed, counter)`, `rand_uniform (seed, counter)` in `[0, 1)`,
+ * `rand_normal (seed, counter)` of mean 0 and deviation 1, and
+ * `rand_int (seed, counter, lo, hi)` in `[lo, hi)`. Prepended to @ref map
+ * kernels whose operation uses them.
+ */
+extern const char *_philox_fmt;
+extern const char *_philox_double_fmt;
+extern const char *_random_fmt;
+/**
+ * @brief Composes random fill kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Each work item draws one Philox4x32-10 block of four words, keyed by the
+ * seed argument and counted from a quarter of the offset argument, and
+ * writes into the elements of A the blocks cover the result of evaluating
+ * the operation. Variables `c` and `w` hold the words of the block and the
+ * index of the current one, `p1` and `p2` the parameters of the
+ * distribution.
+ *
+ * The Philox functions of @ref _philox_fmt are always available to the
+ * operation, the double precision ones of @ref _philox_double_fmt only if
+ * has_double is set.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param ptype String for type of the parameters of the distribution.
+ * @param op1 String for the operation the kernel maps.
+ * @param has_double Whether to define double precision functions.
+ * @return Pointer to null-terminated string.
+ */
+char *get_random (const char *atype, const char *ptype, const char *op1,
+                  int has_double);
+/**
+ * @brief Fill an @ref array with random numbers.
+ *
+ * Sets the elements of A, in memory order, to consecutive draws of a
+ * Philox4x32-10 counter-based generator, starting from the draw numbered
+ * offset of the stream given by seed. Each draw depends only on the seed and
+ * its number, so the result is the same on any device and work group size,
+ * and a later call starting from offset plus the size of A continues the
+ * same stream. Draws match those of `rand_uniform`, `rand_normal` and
+ * `rand_int` in @ref map expressions for float elements.
+ *
+ * Uniform and normal draws need float or double elements and take 24 and 32
+ * bits of their words respectively. Integer draws fit any real element type,
+ * and their range must not exceed 2^32. Normal draws pair consecutive words
+ * through the Box-Muller transform. Blocks and attempts to record timing if
+ * no cl_event is provided, non blocking otherwise.
+ *
+ * @param dist @ref random_distribution of the draws.
+ * @param p1 Lower bound, or mean of normal draws.
+ * @param p2 Upper bound, or standard deviation of normal draws.
+ * @param seed Key of the stream.
+ * @param offset Number of the first draw.
+ * @param A @ref array to fill.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Random projection matrix
+ * FILL_NORMAL(R, 0.0, 1.0 / sqrt (k), seed, 0);
+ * // Monte Carlo in batches continuing the same stream
+ * for (int b = 0; b < batches; b++)
+ *   {
+ *     FILL_UNIFORM(X, 0.0, 1.0, seed, (cl_ulong)b * ARRAY_SIZE (X));
+ *     ...
+ *   }
+ * // Dice
+ * FILL_INTEGERS(D, 1, 7, seed, 0);
+ * @endcode
+ */
+unsigned long long fill_random (random_distribution dist, double p1,
+                                double p2, cl_ulong seed, cl_ulong offset,
+                                array A, cl_event *event);
+#define _FILL_UNIFORM_ONE(A, lo, hi, seed, offset)                            \
+  fill_random (RANDOM_UNIFORM, lo, hi, seed, offset, A, NULL);
+#define _FILL_UNIFORM_TWO(A, lo, hi, seed, offset, event)                     \
+  fill_random (RANDOM_UNIFORM, lo, hi, seed, offset, A, event)
+#define FILL_UNIFORM(...)                                                     \
+  _GETM_SIX (__VA_ARGS__, _FILL_UNIFORM_TWO,                                  \
+             _FILL_UNIFORM_ONE) (__VA_ARGS__) /**< @copydoc fill_random*/
+#define _FILL_NORMAL_ONE(A, mean, stddev, seed, offset)                       \
+  fill_random (RANDOM_NORMAL, mean, stddev, seed, offset, A, NULL);
+#define _FILL_NORMAL_TWO(A, mean, stddev, seed, offset, event)                \
+  fill_random (RANDOM_NORMAL, mean, stddev, seed, offset, A, event)
+#define FILL_NORMAL(...)                                                      \
+  _GETM_SIX (__VA_ARGS__, _FILL_NORMAL_TWO,                                   \
+             _FILL_NORMAL_ONE) (__VA_ARGS__) /**< @copydoc fill_random*/
+#define _FILL_INTEGERS_ONE(A, lo, hi, seed, offset)                           \
+  fill_random (RANDOM_INTEGER, lo, hi, seed, offset, A, NULL);
+#define _FILL_INTEGERS_TWO(A, lo, hi, seed, offset, event)                    \
+  fill_random (RANDOM_INTEGER, lo, hi, seed, offset, A, event)
+#define FILL_INTEGERS(...)                                                    \
+  _GETM_SIX (__VA_ARGS__, _FILL_INTEGERS_TWO,                                 \
+             _FILL_INTEGERS_ONE) (__VA_ARGS__) /**< @copydoc fill_random*/
+
+#endif // RANDOM_H_
@@ -0,0 +1,147 @@
+#include "scan_2d.h"
+#include "cl_utils.h"
+#include <stdio.h>
+
+/* Format strings:
+** 1. A type
+** 2. TILE_SIZE
+** 3. axis
+** 4. A_tile type
+** 5. carry type
+** 6. value type
+** 7. a type
+** 8. b type
+** 9. OP1
+** 10. a type
+** 11. b type
+** 12. OP1
+*/
+const char *_scan_2d_fmt = RAW (__kernel void entry (
+    const int a1, const int a2, const int a3, __global % s * A) {
+  int local_row = get_local_id (1);
+  int local_col = get_local_id (0);
+  const int tile_size = % d;
+  const int axis = % d;
+
+  // Lanes are the lines of the strip, positions run along them, so memory
+  // accesses stay contiguous across local_col for either axis.
+  int lane = axis ? local_col : local_row;
+  int pos = axis ? local_row : local_col;
+  int line = get_group_id (axis ? 0 : 1) * tile_size + lane;
+  int length = axis ? a2 : a1;
+  int lines = axis ? a1 : a2;
+  int plane = get_global_id (2) * a1 * a2;
+
+  __local % s A_tile[tile_size][tile_size + 1];
+  __local % s carry[tile_size];
+
+  for (int start = 0; start < length; start += tile_size)
+    {
+      int along = start + pos;
+      int id = plane + (axis ? along * a1 + line : line * a1 + along);
+      int inside = along < length && line < lines;
+      if (inside)
+        {
+          A_tile[lane][pos] = A[id];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      for (int offset = 1; offset < tile_size; offset *= 2)
+        {
+          % s value = A_tile[lane][pos];
+          if (pos >= offset)
+            {
+              % s a = value;
+              % s b = A_tile[lane][pos - offset];
+              value = % s;
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+          A_tile[lane][pos] = value;
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+
+      if (start > 0)
+        {
+          % s a = A_tile[lane][pos];
+          % s b = carry[lane];
+          A_tile[lane][pos] = % s;
+        }
+      if (inside)
+        {
+          A[id] = A_tile[lane][pos];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      if (pos == tile_size - 1)
+        {
+          carry[lane] = A_tile[lane][pos];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+    }
+});
+
+char *
+get_scan_2d (const char *dtype, const char *op1, int axis)
+{
+  int size = snprintf (NULL, 0, _scan_2d_fmt, dtype, _tile_size, axis, dtype,
+                       dtype, dtype, dtype, dtype, op1, dtype, dtype, op1);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _scan_2d_fmt, dtype, _tile_size,
+                        axis, dtype, dtype, dtype, dtype, dtype, op1, dtype,
+                        dtype, op1);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+scan_2d (const char *op1, array A, cl_event *event)
+{
+  const char *dtype = TYPE_STR_FROM_ENUM (A.type);
+  size_t local_size[] = { _tile_size, _tile_size, 1 };
+
+  cl_event partials[2];
+  int event_count = 0;
+  for (int axis = 0; axis < 2; axis++)
+    {
+      char *src = get_scan_2d (dtype, op1, axis);
+      cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+      free (src);
+      SET_KERNEL_ARGS (kernel, A);
+
+      // One work group spans each strip of lines, sweeping along them.
+      size_t global_size[]
+          = { axis ? LOWEST_MULTIPLE_OF_TILE (A.dim1) : _tile_size,
+              axis ? _tile_size : LOWEST_MULTIPLE_OF_TILE (A.dim2), A.dim3 };
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                        local_size, 0, NULL,
+                                        &partials[event_count++]));
+    }
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
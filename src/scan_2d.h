@@ -0,0 +1,63 @@
+/**
+ * @file scan_2d.h
+ */
+
+#ifndef SCAN_2D_H_
+#define SCAN_2D_H_
+
+#include "cl_utils.h"
+
+extern const char *_scan_2d_fmt;
+/**
+ * @brief Composes strip scan kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the input argument A, every line along the given axis is scanned in
+ * place. Each work group sweeps a strip of tile size lines one tile at a time,
+ * scanning the tile in local memory and carrying the running result of each
+ * line over to the next tile. Variables `a` and `b` hold the current element
+ * and the result preceding it.
+ *
+ * @param dtype String for type of first @ref array of kernel: A.
+ * @param op1 String for the operation the kernel performs.
+ * @param axis 0 to scan along the first dimension, 1 along the second.
+ * @return Pointer to null-terminated string.
+ */
+char *get_scan_2d (const char *dtype, const char *op1, int axis);
+/**
+ * @brief Perform 2D scan operation.
+ *
+ * Scans A in place along its first dimension and then its second, so each
+ * element ends up holding the result of the operation over every element at
+ * or before it along both, like a summed-area table. Planes along the third
+ * dimension are scanned independently. The operation should be associative
+ * and commutative. Blocks and attempts to record timing if no cl_event is
+ * provided, non blocking otherwise.
+ *
+ * @param op1 String of operation to perform.
+ * @param A First argument @ref array of the kernel.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Integral image, the sum of any rectangle is then read from its corners
+ * SCAN_2D("a + b", image);
+ * // Running maximum towards the bottom right
+ * cl_event event;
+ * SCAN_2D("max (a, b)", heights, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long scan_2d (const char *op1, array A, cl_event *event);
+#define _SCAN_2D_ONE(op1, A) scan_2d (op1, A, NULL);
+#define _SCAN_2D_TWO(op1, A, event) scan_2d (op1, A, event)
+#define SCAN_2D(...)                                                          \
+  _GETM_THREE (__VA_ARGS__, _SCAN_2D_TWO,                                     \
+               _SCAN_2D_ONE) (__VA_ARGS__) /**< @copydoc scan_2d*/
+
+#endif // SCAN_2D_H_
@@ -0,0 +1,378 @@
+#include "scan_state.h"
+#include "cl_utils.h"
+#include <stdio.h>
+
+#define SCAN_STATE_ITEMS_PER_WORK_ITEM 16
+
+/*
+** Each work item folds a run of consecutive steps into a state, work groups
+** combine the states of their work items in order, and the states of work
+** groups are scanned along each row before the downsweep repeats the fold
+** starting from the state preceding each work item.
+*/
+
+/* Format strings:
+** 1. state type
+** 2. SCAN_STATE_MAX_SIZE
+** 3. A type
+** 4. a type
+** 5. lift
+** 6. OP1
+** 7. B type
+** 8. result
+*/
+const char *_scan_state_functions_fmt = RAW (
+    typedef % s state_t;
+
+    typedef char state_size_check[sizeof (state_t) <= % d ? 1 : -1];
+
+    state_t lift (__global const % s *x, int i) {
+      % s a = x[0];
+      return % s;
+    }
+
+    state_t combine (state_t a, state_t b) { return % s; }
+
+    % s result (state_t s) { return % s; });
+
+/* Format strings:
+** 1. state functions
+** 2. A type
+** 3. B type
+** 4. group size
+** 5. items per work item
+*/
+const char *_scan_state_reduce_fmt = RAW (
+    % s
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int b1, const int b2, const int b3, __global % s * B,
+        const int p1, const int p2, const int p3, __global char *P) {
+      int row = get_global_id (1);
+      int local_id = get_local_id (0);
+      int group = get_group_id (0);
+      int groups = get_num_groups (0);
+      const int group_size = % d;
+      const int items = % d;
+      __local state_t part[group_size];
+      __global state_t *states = (__global state_t *)P;
+
+      int width = a1 / b1;
+      int begin = (group * group_size + local_id) * items;
+      int end = min (begin + items, b1);
+      int count = min ((b1 - group * group_size * items + items - 1) / items,
+                       group_size);
+
+      state_t acc;
+      for (int t = begin; t < end; t++)
+        {
+          state_t s = lift (&A[row * a1 + t * width], t);
+          acc = t == begin ? s : combine (acc, s);
+        }
+      part[local_id] = acc;
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      for (int s = 1; s < group_size; s *= 2)
+        {
+          if ((local_id & (2 * s - 1)) == 0 && local_id + s < count)
+            {
+              part[local_id] = combine (part[local_id], part[local_id + s]);
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+
+      if (local_id == 0)
+        {
+          states[row * groups + group] = part[0];
+        }
+    });
+
+/* Format strings:
+** 1. state functions
+** 2. B type
+*/
+const char *_scan_state_partials_fmt = RAW (
+    % s
+
+    __kernel void entry (
+        const int b1, const int b2, const int b3, __global % s * B,
+        const int p1, const int p2, const int p3, __global char *P,
+        const int groups) {
+      int row = get_global_id (0);
+      __global state_t *states = (__global state_t *)P;
+
+      if (row < b2 * b3)
+        {
+          state_t acc = states[row * groups];
+          for (int g = 1; g < groups; g++)
+            {
+              state_t s = states[row * groups + g];
+              states[row * groups + g] = acc;
+              acc = combine (acc, s);
+            }
+        }
+    });
+
+/* Format strings:
+** 1. state functions
+** 2. A type
+** 3. B type
+** 4. group size
+** 5. items per work item
+*/
+const char *_scan_state_downsweep_fmt = RAW (
+    % s
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int b1, const int b2, const int b3, __global % s * B,
+        const int p1, const int p2, const int p3, __global char *P) {
+      int row = get_global_id (1);
+      int local_id = get_local_id (0);
+      int group = get_group_id (0);
+      int groups = get_num_groups (0);
+      const int group_size = % d;
+      const int items = % d;
+      __local state_t part[group_size];
+      __global state_t *states = (__global state_t *)P;
+
+      int width = a1 / b1;
+      int begin = (group * group_size + local_id) * items;
+      int end = min (begin + items, b1);
+      int count = min ((b1 - group * group_size * items + items - 1) / items,
+                       group_size);
+
+      state_t acc;
+      for (int t = begin; t < end; t++)
+        {
+          state_t s = lift (&A[row * a1 + t * width], t);
+          acc = t == begin ? s : combine (acc, s);
+        }
+      part[local_id] = acc;
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      for (int offset = 1; offset < group_size; offset *= 2)
+        {
+          state_t s = part[local_id];
+          if (local_id >= offset && local_id < count)
+            {
+              s = combine (part[local_id - offset], s);
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+          part[local_id] = s;
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+
+      state_t prefix;
+      if (local_id > 0)
+        {
+          prefix = part[local_id - 1];
+        }
+      if (group > 0)
+        {
+          state_t before = states[row * groups + group];
+          prefix = local_id > 0 ? combine (before, prefix) : before;
+        }
+
+      for (int t = begin; t < end; t++)
+        {
+          state_t s = lift (&A[row * a1 + t * width], t);
+          if (t > begin)
+            {
+              acc = combine (acc, s);
+            }
+          else
+            {
+              acc = (group > 0 || local_id > 0) ? combine (prefix, s) : s;
+            }
+          B[row * b1 + t] = result (acc);
+        }
+    });
+
+static char *
+get_scan_state_functions (const char *stype, const char *atype,
+                          const char *btype, const char *lift,
+                          const char *op1, const char *result)
+{
+  int size = snprintf (NULL, 0, _scan_state_functions_fmt, stype,
+                       SCAN_STATE_MAX_SIZE, atype, atype, lift, op1, btype,
+                       result);
+
+  char *functions = malloc (size + 1);
+  if (!functions)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (functions, size + 1, _scan_state_functions_fmt, stype,
+                        SCAN_STATE_MAX_SIZE, atype, atype, lift, op1, btype,
+                        result);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return functions;
+}
+
+char *
+get_scan_state_reduce (const char *stype, const char *atype,
+                       const char *btype, const char *lift, const char *op1,
+                       const char *result)
+{
+  char *functions
+      = get_scan_state_functions (stype, atype, btype, lift, op1, result);
+  int group_size = _tile_size * _tile_size;
+  int size = snprintf (NULL, 0, _scan_state_reduce_fmt, functions, atype,
+                       btype, group_size, SCAN_STATE_ITEMS_PER_WORK_ITEM);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _scan_state_reduce_fmt, functions,
+                        atype, btype, group_size,
+                        SCAN_STATE_ITEMS_PER_WORK_ITEM);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (functions);
+
+  return kernel;
+}
+
+char *
+get_scan_state_partials (const char *stype, const char *atype,
+                         const char *btype, const char *lift, const char *op1,
+                         const char *result)
+{
+  char *functions
+      = get_scan_state_functions (stype, atype, btype, lift, op1, result);
+  int size = snprintf (NULL, 0, _scan_state_partials_fmt, functions, btype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _scan_state_partials_fmt, functions,
+                        btype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (functions);
+
+  return kernel;
+}
+
+char *
+get_scan_state_downsweep (const char *stype, const char *atype,
+                          const char *btype, const char *lift,
+                          const char *op1, const char *result)
+{
+  char *functions
+      = get_scan_state_functions (stype, atype, btype, lift, op1, result);
+  int group_size = _tile_size * _tile_size;
+  int size = snprintf (NULL, 0, _scan_state_downsweep_fmt, functions, atype,
+                       btype, group_size, SCAN_STATE_ITEMS_PER_WORK_ITEM);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _scan_state_downsweep_fmt,
+                        functions, atype, btype, group_size,
+                        SCAN_STATE_ITEMS_PER_WORK_ITEM);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (functions);
+
+  return kernel;
+}
+
+unsigned long long
+scan_state (const char *stype, const char *lift, const char *op1,
+            const char *result, array A, array B, cl_event *event)
+{
+  int rows = B.dim2 * B.dim3;
+  if (A.dim2 * A.dim3 != rows || A.dim1 % B.dim1 != 0)
+    {
+      handle_error ("Cannot scan rows of %dx%dx%d array into %dx%dx%d array",
+                    A.dim1, A.dim2, A.dim3, B.dim1, B.dim2, B.dim3);
+      return 0;
+    }
+
+  const char *atype = TYPE_STR_FROM_ENUM (A.type);
+  const char *btype = TYPE_STR_FROM_ENUM (B.type);
+  int group_size = _tile_size * _tile_size;
+  int chunk = group_size * SCAN_STATE_ITEMS_PER_WORK_ITEM;
+  int groups = (B.dim1 + chunk - 1) / chunk;
+  array P = ALLOC_ARRAY (char, CL_MEM_READ_WRITE,
+                         SCAN_STATE_MAX_SIZE * groups, rows);
+
+  char *src_reduce
+      = get_scan_state_reduce (stype, atype, btype, lift, op1, result);
+  cl_kernel kernel_reduce = TRY_COMPILE_KERNEL (src_reduce);
+  free (src_reduce);
+  SET_KERNEL_ARGS (kernel_reduce, A, B, P);
+
+  char *src_partials
+      = get_scan_state_partials (stype, atype, btype, lift, op1, result);
+  cl_kernel kernel_partials = TRY_COMPILE_KERNEL (src_partials);
+  free (src_partials);
+  int idx = SET_KERNEL_ARGS (kernel_partials, B, P);
+  CHECK_CL (clSetKernelArg (kernel_partials, idx, sizeof (int), &groups));
+
+  char *src_downsweep
+      = get_scan_state_downsweep (stype, atype, btype, lift, op1, result);
+  cl_kernel kernel_downsweep = TRY_COMPILE_KERNEL (src_downsweep);
+  free (src_downsweep);
+  SET_KERNEL_ARGS (kernel_downsweep, A, B, P);
+
+  size_t local_size[] = { group_size, 1 };
+  size_t global_size[] = { groups * group_size, rows };
+  size_t partials_local_size[] = { _tile_size };
+  size_t partials_global_size[] = { LOWEST_MULTIPLE_OF_TILE (rows) };
+
+  cl_event partials[3];
+  int event_count = 0;
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel_reduce, 2, NULL,
+                                    global_size, local_size, 0, NULL,
+                                    &partials[event_count++]));
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel_partials, 1, NULL,
+                                    partials_global_size, partials_local_size,
+                                    0, NULL, &partials[event_count++]));
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel_downsweep, 2, NULL,
+                                    global_size, local_size, 0, NULL,
+                                    &partials[event_count++]));
+
+  FREE_ARRAY (P);
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file scan_state.h
+ */
+
+#ifndef SCAN_STATE_H_
+#define SCAN_STATE_H_
+
+#include "cl_utils.h"
+
+/**
+ * @brief Largest state in bytes, can be overriden.
+ *
+ * Bounds the scratch space kept for the state of each work group. Kernels with
+ * larger states fail to compile.
+ */
+#ifndef SCAN_STATE_MAX_SIZE
+#define SCAN_STATE_MAX_SIZE 64
+#endif
+
+extern const char *_scan_state_functions_fmt;
+extern const char *_scan_state_reduce_fmt;
+extern const char *_scan_state_partials_fmt;
+extern const char *_scan_state_downsweep_fmt;
+/**
+ * @brief Composes state scan reduction kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * For each row, every work group reduces its chunk of elements, lifted into
+ * states, to a single state in the scratch argument P.
+ *
+ * @param stype String for the state type.
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param btype String for type of second @ref array of kernel: B.
+ * @param lift String for the expression lifting an element into a state.
+ * @param op1 String for the operation combining two states.
+ * @param result String for the expression turning a state into an element.
+ * @return Pointer to null-terminated string.
+ */
+char *get_scan_state_reduce (const char *stype, const char *atype,
+                             const char *btype, const char *lift,
+                             const char *op1, const char *result);
+/**
+ * @brief Composes state scan partials kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * For each row, replaces the state of each work group in P by the combination
+ * of the states of the work groups before it.
+ *
+ * @copydetails get_scan_state_reduce
+ */
+char *get_scan_state_partials (const char *stype, const char *atype,
+                               const char *btype, const char *lift,
+                               const char *op1, const char *result);
+/**
+ * @brief Composes state scan downsweep kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the second input argument B, the result of every state of the scan is
+ * written, starting each work group from the state of the ones before it in
+ * P.
+ *
+ * @copydetails get_scan_state_reduce
+ */
+char *get_scan_state_downsweep (const char *stype, const char *atype,
+                                const char *btype, const char *lift,
+                                const char *op1, const char *result);
+/**
+ * @brief Perform scan over user-defined state.
+ *
+ * Scans each row of B, lifting every step of the row of A into a state,
+ * combining states in order, and writing the result of each running state
+ * into B. The state can be any type no larger than SCAN_STATE_MAX_SIZE,
+ * such as a vector type or an anonymous struct, and is named `state_t` within
+ * the expressions. Rows of A hold a multiple of the elements of rows of B,
+ * split evenly between steps.
+ *
+ * The lift expression sees `x`, the pointer to the elements of the current
+ * step, `a` its first element, and `i` the index of the step in the row. The
+ * combining operation sees states `a` and `b`, the first preceding the second,
+ * and must be associative. The result expression sees the state `s`. Blocks
+ * and attempts to record timing if no cl_event is provided, non blocking
+ * otherwise.
+ *
+ * @param stype String of the state type.
+ * @param lift String of expression lifting a step into a state.
+ * @param op1 String of operation combining states.
+ * @param result String of expression turning a state into an element.
+ * @param A @ref array of inputs.
+ * @param B @ref array to write results into.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // x_i = c_i * x_(i - 1) + d_i, from A holding (c_i, d_i) pairs
+ * array X = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, A.dim1 / 2);
+ * SCAN_STATE("float2", "(float2)(x[0], x[1])",
+ *            "(float2)(a.x * b.x, b.x * a.y + b.y)", "s.y", A, X);
+ * // Running mean of a series
+ * cl_event event;
+ * SCAN_STATE("struct { float sum; int n; }", "(state_t){ a, 1 }",
+ *            "(state_t){ a.sum + b.sum, a.n + b.n }", "s.sum / s.n",
+ *            series, means, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long scan_state (const char *stype, const char *lift,
+                               const char *op1, const char *result, array A,
+                               array B, cl_event *event);
+#define _SCAN_STATE_ONE(stype, lift, op1, result, A, B)                       \
+  scan_state (stype, lift, op1, result, A, B, NULL);
+#define _SCAN_STATE_TWO(stype, lift, op1, result, A, B, event)                \
+  scan_state (stype, lift, op1, result, A, B, event)
+#define SCAN_STATE(...)                                                       \
+  _GETM_SEVEN (__VA_ARGS__, _SCAN_STATE_TWO,                                  \
+               _SCAN_STATE_ONE) (__VA_ARGS__) /**< @copydoc scan_state*/
+
+#endif // SCAN_STATE_H_
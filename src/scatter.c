@@ -0,0 +1,188 @@
+#include "scatter.h"
+#include "cl_utils.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Format strings:
+** 1. A type
+** 2. I type
+** 3. B type
+*/
+const char *_scatter_fmt = RAW (__kernel void entry (
+    const int a1, const int a2, const int a3, __global const % s * A,
+    const int i1, const int i2, const int i3, __global const % s * I,
+    const int b1, const int b2, const int b3, __global % s * B) {
+  int global_id = get_global_id (0);
+
+  int count = i1 * i2 * i3;
+  int width = (a1 * a2 * a3) / count;
+  int rows = (b1 * b2 * b3) / width;
+  if (global_id < count * width)
+    {
+      int i = global_id / width;
+      int idx = I[i];
+      if (idx >= 0 && idx < rows)
+        {
+          B[idx * width + global_id - i * width] = A[global_id];
+        }
+    }
+});
+
+/* Format strings:
+** 1. extension pragma
+** 2. word type
+** 3. B type
+** 4. A type
+** 5. B type
+** 6. B type
+** 7. word type
+** 8. B type
+** 9. OP1
+** 10. cmpxchg function
+** 11. A type
+** 12. I type
+** 13. B type
+*/
+const char *_scatter_combine_fmt = RAW (
+    % s
+
+    typedef % s word_t;
+
+    void combine (__global % s *p, % s a) {
+      volatile __global word_t *q = (volatile __global word_t *)p;
+      word_t old = *q;
+      while (1)
+        {
+          % s b = as_% s (old);
+          word_t next = as_% s ((% s)(% s));
+          word_t prev = % s (q, old, next);
+          if (prev == old)
+            {
+              break;
+            }
+          old = prev;
+        }
+    }
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int i1, const int i2, const int i3, __global const % s * I,
+        const int b1, const int b2, const int b3, __global % s * B) {
+      int global_id = get_global_id (0);
+
+      int count = i1 * i2 * i3;
+      int width = (a1 * a2 * a3) / count;
+      int rows = (b1 * b2 * b3) / width;
+      if (global_id < count * width)
+        {
+          int i = global_id / width;
+          int idx = I[i];
+          if (idx >= 0 && idx < rows)
+            {
+              combine (&B[idx * width + global_id - i * width], A[global_id]);
+            }
+        }
+    });
+
+char *
+get_scatter (const char *atype, const char *itype, const char *btype)
+{
+  int size = snprintf (NULL, 0, _scatter_fmt, atype, itype, btype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _scatter_fmt, atype, itype, btype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+/*
+** Elements of B are reinterpreted as words of the same size to retry the
+** combination with compare and exchange until no other write intervened.
+*/
+char *
+get_scatter_combine (const char *atype, const char *itype, const char *btype,
+                     const char *op1)
+{
+  const char *pragma = "";
+  const char *wtype = "int";
+  const char *cmpxchg = "atomic_cmpxchg";
+  if (strcmp (btype, "long") == 0 || strcmp (btype, "double") == 0)
+    {
+      pragma = "\n#pragma OPENCL EXTENSION cl_khr_int64_base_atomics : "
+               "enable\n";
+      wtype = "long";
+      cmpxchg = "atom_cmpxchg";
+    }
+  else if (strcmp (btype, "int") != 0 && strcmp (btype, "float") != 0)
+    {
+      handle_error ("Unimplemented scatter combine type %s", btype);
+    }
+
+  int size = snprintf (NULL, 0, _scatter_combine_fmt, pragma, wtype, btype,
+                       atype, btype, btype, wtype, btype, op1, cmpxchg, atype,
+                       itype, btype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _scatter_combine_fmt, pragma, wtype,
+                        btype, atype, btype, btype, wtype, btype, op1, cmpxchg,
+                        atype, itype, btype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+scatter (const char *op1, array A, array I, array B, cl_event *event)
+{
+  cl_event _event;
+  if (ARRAY_SIZE (A) % ARRAY_SIZE (I) != 0
+      || ARRAY_SIZE (B) % (ARRAY_SIZE (A) / ARRAY_SIZE (I)) != 0)
+    {
+      handle_error ("Cannot scatter %d elements by %d indices into %d",
+                    ARRAY_SIZE (A), ARRAY_SIZE (I), ARRAY_SIZE (B));
+      return 0;
+    }
+
+  const char *atype = TYPE_STR_FROM_ENUM (A.type);
+  const char *itype = TYPE_STR_FROM_ENUM (I.type);
+  const char *btype = TYPE_STR_FROM_ENUM (B.type);
+  char *src = op1 ? get_scatter_combine (atype, itype, btype, op1)
+                  : get_scatter (atype, itype, btype);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  SET_KERNEL_ARGS (kernel, A, I, B);
+
+  size_t local_size[] = { _tile_size };
+  size_t global_size[] = { LOWEST_MULTIPLE_OF_TILE (ARRAY_SIZE (A)) };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    event ? event : &_event));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
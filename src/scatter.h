@@ -0,0 +1,92 @@
+/**
+ * @file scatter.h
+ */
+
+#ifndef SCATTER_H_
+#define SCATTER_H_
+
+#include "cl_utils.h"
+
+extern const char *_scatter_fmt;
+extern const char *_scatter_combine_fmt;
+/**
+ * @brief Composes scatter kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the third input argument B, the rows of A are written in order at the
+ * rows indexed by I. Rows are as long as A has elements per index in I.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param itype String for type of second @ref array of kernel: I.
+ * @param btype String for type of third @ref array of kernel: B.
+ * @return Pointer to null-terminated string.
+ */
+char *get_scatter (const char *atype, const char *itype, const char *btype);
+/**
+ * @brief Composes combining scatter kernel.
+ *
+ * Constructs the kernel with the specified types and operation, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Like @ref get_scatter, but each element of B is atomically replaced by the
+ * result of op1 with `a` the element of A and `b` the element of B, so
+ * colliding indices all take effect.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param itype String for type of second @ref array of kernel: I.
+ * @param btype String for type of third @ref array of kernel: B.
+ * @param op1 String for operation combining elements of A into B.
+ * @return Pointer to null-terminated string.
+ */
+char *get_scatter_combine (const char *atype, const char *itype,
+                           const char *btype, const char *op1);
+/**
+ * @brief Perform scatter operation.
+ *
+ * Writes `B[I[i]] = A[i]` for every index in I. If A has several elements per
+ * index, B is split into rows of that many elements and whole rows are
+ * scattered. Indices out of the range of rows of B are skipped. If op1 is
+ * NULL, which of several colliding writes lands is undefined. Otherwise
+ * `B[I[i]] = op1` is applied atomically with `a = A[i]` and `b = B[I[i]]`, so
+ * op1 should be commutative and associative for a deterministic result.
+ * Combining needs B of int, float, long or double, the latter two on devices
+ * with 64 bit atomics. Blocks and attempts to record timing if no cl_event is
+ * provided, non blocking otherwise.
+ *
+ * @param op1 Optional. String for operation combining collisions, or NULL.
+ * @param A @ref array to read from.
+ * @param I @ref array of integer indices into B.
+ * @param B @ref array to write into.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Apply the inverse of a permutation
+ * SCATTER(A, perm, B);
+ * // Sum values by key, B starts zeroed
+ * cl_event event;
+ * SCATTER_COMBINE("a + b", values, keys, B, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long scatter (const char *op1, array A, array I, array B,
+                            cl_event *event);
+#define _SCATTER_ONE(A, I, B) scatter (NULL, A, I, B, NULL);
+#define _SCATTER_TWO(A, I, B, event) scatter (NULL, A, I, B, event)
+#define SCATTER(...)                                                          \
+  _GETM_FOUR (__VA_ARGS__, _SCATTER_TWO,                                      \
+              _SCATTER_ONE) (__VA_ARGS__) /**< @copydoc scatter*/
+#define _SCATTER_COMBINE_ONE(op1, A, I, B) scatter (op1, A, I, B, NULL);
+#define _SCATTER_COMBINE_TWO(op1, A, I, B, event) scatter (op1, A, I, B, event)
+#define SCATTER_COMBINE(...)                                                  \
+  _GETM_FIVE (__VA_ARGS__, _SCATTER_COMBINE_TWO,                              \
+              _SCATTER_COMBINE_ONE) (__VA_ARGS__) /**< @copydoc scatter*/
+
+#endif // SCATTER_H_
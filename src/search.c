@@ -0,0 +1,142 @@
+#include "search.h"
+#include "cl_utils.h"
+#include <stdio.h>
+
+/*
+** Queries searched by each work item, so that staging the samples is spread
+** over several queries.
+*/
+#define SEARCH_QUERIES_PER_WORK_ITEM 4
+
+/* Format strings:
+** 1. a type
+** 2. b type
+** 3. OP1
+** 4. S type
+** 5. Q type
+** 6. samples
+** 7. upper
+** 8. tree type
+** 9. q type
+*/
+const char *_search_fmt = RAW (
+    int before (% s a, % s b) { return % s; }
+
+    __kernel void entry (
+        const int s1, const int s2, const int s3, __global const % s * S,
+        const int q1, const int q2, const int q3, __global const % s * Q,
+        const int i1, const int i2, const int i3, __global int *I) {
+      const int samples = % d;
+      const int upper = % d;
+      __local % s tree[samples ? samples : 1];
+
+      int n = s1 * s2 * s3;
+      int m = min (n, samples);
+      for (int k = get_local_id (0); k < m; k += get_local_size (0))
+        {
+          tree[k] = S[(long)k * n / m];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      int total = q1 * q2 * q3;
+      for (int i = get_global_id (0); i < total; i += get_global_size (0))
+        {
+          % s q = Q[i];
+
+          int first = 0;
+          int last = m;
+          while (first < last)
+            {
+              int mid = (first + last) / 2;
+              if (upper ? !before (q, tree[mid]) : before (tree[mid], q))
+                {
+                  first = mid + 1;
+                }
+              else
+                {
+                  last = mid;
+                }
+            }
+
+          int lo = first ? (int)((long)(first - 1) * n / m) + 1 : 0;
+          int hi = first < m ? (int)((long)first * n / m) : n;
+          while (lo < hi)
+            {
+              int mid = (lo + hi) / 2;
+              if (upper ? !before (q, S[mid]) : before (S[mid], q))
+                {
+                  lo = mid + 1;
+                }
+              else
+                {
+                  hi = mid;
+                }
+            }
+          I[i] = lo;
+        }
+    });
+
+char *
+get_search (const char *stype, const char *qtype, const char *op1,
+            int samples, int upper)
+{
+  int size = snprintf (NULL, 0, _search_fmt, stype, stype, op1, stype, qtype,
+                       samples, upper, stype, stype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _search_fmt, stype, stype, op1,
+                        stype, qtype, samples, upper, stype, stype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+sorted_search (const char *op1, int upper, array S, array Q, array I,
+               cl_event *event)
+{
+  cl_event _event;
+  if (I.type != TYPE_INT || ARRAY_SIZE (I) != ARRAY_SIZE (Q))
+    {
+      handle_error ("Search indices must be an array of int as large as the "
+                    "queries, got %s of %d for %d queries",
+                    TYPE_STR_FROM_ENUM (I.type), ARRAY_SIZE (I),
+                    ARRAY_SIZE (Q));
+      return 0;
+    }
+
+  char *src = get_search (TYPE_STR_FROM_ENUM (S.type),
+                          TYPE_STR_FROM_ENUM (Q.type), op1,
+                          SEARCH_LOCAL_SAMPLES, upper);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  SET_KERNEL_ARGS (kernel, S, Q, I);
+
+  size_t local_size[] = { _tile_size * _tile_size };
+  size_t groups
+      = (ARRAY_SIZE (Q) + SEARCH_QUERIES_PER_WORK_ITEM * local_size[0] - 1)
+        / (SEARCH_QUERIES_PER_WORK_ITEM * local_size[0]);
+  size_t global_size[] = { (groups ? groups : 1) * local_size[0] };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    event ? event : &_event));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file search.h
+ */
+
+#ifndef SEARCH_H_
+#define SEARCH_H_
+
+#include "cl_utils.h"
+
+/**
+ * @brief Elements of the sorted array staged in local memory, can be
+ * overriden.
+ *
+ * Each work group of a search loads this many evenly spaced elements of the
+ * sorted array, the top levels of its search tree, into local memory, so
+ * only the last steps of every search read global memory. Sorted arrays no
+ * longer than this are searched entirely in local memory. Setting it to 0
+ * searches global memory alone.
+ */
+#ifndef SEARCH_LOCAL_SAMPLES
+#define SEARCH_LOCAL_SAMPLES 1024
+#endif
+
+extern const char *_search_fmt;
+/**
+ * @brief Composes sorted search kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the third input argument I, writes for each element of Q the index of
+ * the first element of S it does not go after, or if upper is set the first
+ * element it goes before. Each work group stages the given number of evenly
+ * spaced elements of S in local memory and searches them first, narrowing
+ * the search of S to the range between two of them. Variables `a` and `b`
+ * hold a pair of values, and op1 must evaluate to true when `a` goes before
+ * `b`.
+ *
+ * @param stype String for type of first @ref array of kernel: S.
+ * @param qtype String for type of second @ref array of kernel: Q.
+ * @param op1 String for the comparison S is sorted by.
+ * @param samples Elements of S staged in local memory.
+ * @param upper Whether to find upper rather than lower bounds.
+ * @return Pointer to null-terminated string.
+ */
+char *get_search (const char *stype, const char *qtype, const char *op1,
+                  int samples, int upper);
+/**
+ * @brief Perform sorted search operation.
+ *
+ * Writes into the int @ref array I, for each element of Q, the index into S
+ * of its lower bound, the first element of S not going before it, or of its
+ * upper bound, the first element of S going after it. Either is the number of
+ * elements of S if there is none. S is taken as a flat array sorted by op1,
+ * and queries are compared as elements of its type. Lower and upper bounds
+ * delimit the elements of S equal to a query. Blocks and attempts to record
+ * timing if no cl_event is provided, non blocking otherwise.
+ *
+ * @param op1 String of comparison S is sorted by.
+ * @param upper Whether to find upper rather than lower bounds.
+ * @param S Sorted @ref array to search.
+ * @param Q @ref array of queries.
+ * @param I @ref array of int to write the indices into.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * The input operation is evaluated on pairs of values, within the scope of
+ * which the variables `a` and `b` exist that hold the values being compared,
+ * and must be true when `a` goes before `b`.
+ * @code
+ * // Bucket of each value, with buckets [edges[i - 1], edges[i])
+ * UPPER_BOUND("a < b", edges, values, buckets);
+ * // Range of sorted_keys, in descending order, joining with each key
+ * LOWER_BOUND("a > b", sorted_keys, keys, first);
+ * cl_event event;
+ * UPPER_BOUND("a > b", sorted_keys, keys, last, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long sorted_search (const char *op1, int upper, array S, array Q,
+                                  array I, cl_event *event);
+#define _LOWER_BOUND_ONE(op1, S, Q, I) sorted_search (op1, 0, S, Q, I, NULL);
+#define _LOWER_BOUND_TWO(op1, S, Q, I, event)                                 \
+  sorted_search (op1, 0, S, Q, I, event)
+#define LOWER_BOUND(...)                                                      \
+  _GETM_FIVE (__VA_ARGS__, _LOWER_BOUND_TWO,                                  \
+              _LOWER_BOUND_ONE) (__VA_ARGS__) /**< @copydoc sorted_search*/
+#define _UPPER_BOUND_ONE(op1, S, Q, I) sorted_search (op1, 1, S, Q, I, NULL);
+#define _UPPER_BOUND_TWO(op1, S, Q, I, event)                                 \
+  sorted_search (op1, 1, S, Q, I, event)
+#define UPPER_BOUND(...)                                                      \
+  _GETM_FIVE (__VA_ARGS__, _UPPER_BOUND_TWO,                                  \
+              _UPPER_BOUND_ONE) (__VA_ARGS__) /**< @copydoc sorted_search*/
+
+#endif // SEARCH_H_
@@ -0,0 +1,574 @@
+#include "sparse.h"
+#include "batched_sort.h"
+#include "cl_utils.h"
+#include "scan_state.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+** Rows with more nonzeros than this are split over several work groups,
+** whose partial results are reduced by a second pass.
+*/
+#define SPARSE_SPLIT_NNZ (16 * SPARSE_BLOCK_NNZ)
+
+/*
+** Each row block holds its first row, the row after its last, and the range
+** of nonzeros it covers. Chunks of a split row are marked by ending on the
+** row they begin on.
+*/
+#define SPARSE_BLOCK_FIELDS 4
+
+/* Format strings:
+** 1. V type
+** 2. W type
+*/
+const char *_coo_to_csr_fmt = RAW (__kernel void entry (
+    const int r1, const int r2, const int r3, __global const int *R,
+    const int c1, const int c2, const int c3, __global const int *C,
+    const int v1, const int v2, const int v3, __global const % s * V,
+    const int o1, const int o2, const int o3, __global const int *O,
+    const int f1, const int f2, const int f3, __global int *F,
+    const int i1, const int i2, const int i3, __global int *I,
+    const int w1, const int w2, const int w3, __global % s * W,
+    const int phase) {
+  int k = get_global_id (0);
+
+  if (k < r1 * r2 * r3)
+    {
+      int row = R[k];
+      if (phase == 0)
+        {
+          atomic_inc (&F[row + 1]);
+        }
+      else
+        {
+          int pos = O[row] + atomic_inc (&F[row]);
+          I[pos] = C[k];
+          W[pos] = V[k];
+        }
+    }
+});
+
+/* Format strings:
+** 1. C type
+** 2. C type
+** 3. C type
+** 4. OP1 expression
+** 5. C type
+** 6. V type
+** 7. B type
+** 8. OP2 expression
+** 9. V type
+** 10. B type
+** 11. C type
+** 12. P type
+** 13. local size
+** 14. partial type
+** 15. acc type
+** 16. acc type
+*/
+const char *_spmm_fmt = RAW (
+    % s reduce (% s a, % s b) { return % s; }
+
+    % s pair (% s a, % s b) { return % s; }
+
+    __kernel void entry (
+        const int o1, const int o2, const int o3, __global const int *O,
+        const int i1, const int i2, const int i3, __global const int *I,
+        const int v1, const int v2, const int v3, __global const % s * V,
+        const int r1, const int r2, const int r3, __global const int *R,
+        const int b1, const int b2, const int b3, __global const % s * B,
+        const int c1, const int c2, const int c3, __global % s * C,
+        const int p1, const int p2, const int p3, __global % s * P,
+        const int n) {
+      int block = get_group_id (0);
+      int col = get_global_id (1);
+      int local_id = get_local_id (0);
+      const int local_size = % d;
+      __local % s partial[local_size];
+
+      int row_begin = R[block * r1];
+      int row_end = R[block * r1 + 1];
+      int begin = R[block * r1 + 2];
+      int end = R[block * r1 + 3];
+
+      // Runs of short rows stage the products of all their nonzeros, then
+      // each work item reduces one row from local memory.
+      if (row_end - row_begin > 1)
+        {
+          for (int k = begin + local_id; k < end; k += local_size)
+            {
+              partial[k - begin] = pair (V[k], B[I[k] * n + col]);
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+
+          int row = row_begin + local_id;
+          if (row < row_end && O[row] < O[row + 1])
+            {
+              % s acc = partial[O[row] - begin];
+              for (int k = O[row] + 1; k < O[row + 1]; k++)
+                {
+                  acc = reduce (acc, partial[k - begin]);
+                }
+              C[row * n + col] = acc;
+            }
+          return;
+        }
+
+      // A longer row, or a chunk of a split one, is reduced by the whole
+      // work group in strided slices and then in a tree.
+      if (local_id < end - begin)
+        {
+          int k = begin + local_id;
+          % s acc = pair (V[k], B[I[k] * n + col]);
+          for (k += local_size; k < end; k += local_size)
+            {
+              acc = reduce (acc, pair (V[k], B[I[k] * n + col]));
+            }
+          partial[local_id] = acc;
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      int count = min (local_size, end - begin);
+      for (int s = local_size / 2; s > 0; s >>= 1)
+        {
+          if (local_id < s && local_id + s < count)
+            {
+              partial[local_id] = reduce (partial[local_id],
+                                          partial[local_id + s]);
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+
+      if (local_id == 0 && count > 0)
+        {
+          if (row_end == row_begin)
+            {
+              P[block * n + col] = partial[0];
+            }
+          else
+            {
+              C[row_begin * n + col] = partial[0];
+            }
+        }
+    });
+
+/* Format strings:
+** 1. C type
+** 2. C type
+** 3. C type
+** 4. OP1 expression
+** 5. P type
+** 6. C type
+** 7. acc type
+*/
+const char *_spmm_combine_fmt = RAW (
+    % s reduce (% s a, % s b) { return % s; }
+
+    __kernel void entry (
+        const int r1, const int r2, const int r3, __global const int *R,
+        const int p1, const int p2, const int p3, __global const % s * P,
+        const int c1, const int c2, const int c3, __global % s * C,
+        const int n) {
+      int block = get_global_id (0);
+      int col = get_global_id (1);
+
+      if (block >= r2 || col >= n)
+        {
+          return;
+        }
+
+      // The first chunk of each split row reduces the partials of the
+      // chunks following it.
+      int row = R[block * r1];
+      if (R[block * r1 + 1] != row
+          || (block > 0 && R[(block - 1) * r1] == row))
+        {
+          return;
+        }
+
+      % s acc = P[block * n + col];
+      for (int b = block + 1; b < r2 && R[b * r1] == row; b++)
+        {
+          acc = reduce (acc, P[b * n + col]);
+        }
+      C[row * n + col] = acc;
+    });
+
+/*
+** Writes the row blocks of the offsets O into blocks if given, and returns
+** how many there are, so it can be called once to size the array.
+*/
+static int
+get_sparse_blocks (const int *O, int rows, int *blocks)
+{
+  int count = 0;
+  int row = 0;
+  while (row < rows)
+    {
+      int first = row;
+      int length = O[row + 1] - O[row];
+      if (length > SPARSE_BLOCK_NNZ)
+        {
+          int chunks = (length + SPARSE_SPLIT_NNZ - 1) / SPARSE_SPLIT_NNZ;
+          for (int c = 0; c < chunks; c++, count++)
+            {
+              if (blocks)
+                {
+                  int *block = blocks + count * SPARSE_BLOCK_FIELDS;
+                  block[0] = row;
+                  block[1] = chunks > 1 ? row : row + 1;
+                  block[2] = O[row] + c * SPARSE_SPLIT_NNZ;
+                  block[3] = c + 1 < chunks ? block[2] + SPARSE_SPLIT_NNZ
+                                            : O[row + 1];
+                }
+            }
+          row++;
+          continue;
+        }
+
+      while (row < rows && row - first < SPARSE_BLOCK_NNZ
+             && O[row + 1] - O[first] <= SPARSE_BLOCK_NNZ)
+        {
+          row++;
+        }
+      if (blocks)
+        {
+          int *block = blocks + count * SPARSE_BLOCK_FIELDS;
+          block[0] = first;
+          block[1] = row;
+          block[2] = O[first];
+          block[3] = O[row];
+        }
+      count++;
+    }
+
+  return count;
+}
+
+csr_matrix
+alloc_csr (array_type type, cl_mem_flags flags, int rows, int cols, int nnz)
+{
+  csr_matrix M;
+  M.rows = rows;
+  M.cols = cols;
+  M.offsets = ALLOC_ARRAY (int, flags, rows + 1);
+  M.columns = ALLOC_ARRAY (int, flags, nnz);
+  M.values = alloc_array (type, flags, nnz, 1, 1);
+  memset (&M.blocks, 0, sizeof (M.blocks));
+
+  return M;
+}
+
+void
+free_csr (csr_matrix M)
+{
+  FREE_ARRAY (M.offsets);
+  FREE_ARRAY (M.columns);
+  FREE_ARRAY (M.values);
+  if (M.blocks.device)
+    {
+      FREE_ARRAY (M.blocks);
+    }
+}
+
+void
+partition_csr (csr_matrix *M)
+{
+  SYNC_ARRAY_FROM_DEVICE (M->offsets);
+  if (M->blocks.device)
+    {
+      FREE_ARRAY (M->blocks);
+      memset (&M->blocks, 0, sizeof (M->blocks));
+    }
+
+  int count = get_sparse_blocks (M->offsets.ints, M->rows, NULL);
+  if (count < 1)
+    return;
+
+  M->blocks = ALLOC_ARRAY (int, CL_MEM_READ_ONLY, SPARSE_BLOCK_FIELDS, count);
+  get_sparse_blocks (M->offsets.ints, M->rows, M->blocks.ints);
+  SYNC_ARRAY_TO_DEVICE (M->blocks);
+}
+
+char *
+get_coo_to_csr (const char *vtype, const char *wtype)
+{
+  int size = snprintf (NULL, 0, _coo_to_csr_fmt, vtype, wtype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _coo_to_csr_fmt, vtype, wtype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+char *
+get_spmm (const char *vtype, const char *btype, const char *ctype,
+          const char *op1, const char *op2, int local_size)
+{
+  char *reduce = get_op_expression (op1);
+  char *pair = get_op_expression (op2);
+  int size = snprintf (NULL, 0, _spmm_fmt, ctype, ctype, ctype, reduce, ctype,
+                       vtype, btype, pair, vtype, btype, ctype, ctype,
+                       local_size, ctype, ctype, ctype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _spmm_fmt, ctype, ctype, ctype,
+                        reduce, ctype, vtype, btype, pair, vtype, btype, ctype,
+                        ctype, local_size, ctype, ctype, ctype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (reduce);
+  free (pair);
+
+  return kernel;
+}
+
+char *
+get_spmm_combine (const char *ctype, const char *op1)
+{
+  char *reduce = get_op_expression (op1);
+  int size = snprintf (NULL, 0, _spmm_combine_fmt, ctype, ctype, ctype, reduce,
+                       ctype, ctype, ctype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _spmm_combine_fmt, ctype, ctype,
+                        ctype, reduce, ctype, ctype, ctype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+  free (reduce);
+
+  return kernel;
+}
+
+unsigned long long
+coo_to_csr (array R, array C, array V, csr_matrix *M, cl_event *event)
+{
+  int nnz = ARRAY_SIZE (M->values);
+  if (R.type != TYPE_INT || C.type != TYPE_INT)
+    {
+      handle_error ("COO rows and columns must be arrays of int");
+      return 0;
+    }
+  if (ARRAY_SIZE (R) != nnz || ARRAY_SIZE (C) != nnz || ARRAY_SIZE (V) != nnz)
+    {
+      handle_error ("Cannot convert %d, %d and %d COO entries into a CSR "
+                    "matrix of %d nonzeros",
+                    ARRAY_SIZE (R), ARRAY_SIZE (C), ARRAY_SIZE (V), nnz);
+      return 0;
+    }
+
+  array F = ALLOC_ARRAY (int, CL_MEM_READ_WRITE, M->rows + 1);
+
+  char *src = get_coo_to_csr (TYPE_STR_FROM_ENUM (V.type),
+                              TYPE_STR_FROM_ENUM (M->values.type));
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  int idx = set_kernel_args (kernel, 7, R, C, V, M->offsets, F, M->columns,
+                             M->values);
+
+  cl_event partials[8];
+  int event_count = 0;
+  int zero = 0;
+  CHECK_CL (clEnqueueFillBuffer (_queue, F.device, &zero, sizeof (zero), 0,
+                                 ARRAY_SIZE (F) * sizeof (int), 0, NULL,
+                                 &partials[event_count++]));
+
+  size_t local_size[] = { _tile_size * _tile_size };
+  size_t global_size[]
+      = { (nnz + local_size[0] - 1) / local_size[0] * local_size[0] };
+  for (int phase = 0; phase < 2; phase++)
+    {
+      CHECK_CL (clSetKernelArg (kernel, idx, sizeof (int), &phase));
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 1, NULL, global_size,
+                                        local_size, 0, NULL,
+                                        &partials[event_count++]));
+
+      // Counts of rows become offsets of their first nonzero, and the
+      // counts are cleared to count positions taken within each row.
+      if (phase == 0)
+        {
+          scan_state ("int", "a", "a + b", "s", F, M->offsets,
+                      &partials[event_count++]);
+          CHECK_CL (clEnqueueFillBuffer (_queue, F.device, &zero,
+                                         sizeof (zero), 0,
+                                         ARRAY_SIZE (F) * sizeof (int), 0,
+                                         NULL, &partials[event_count++]));
+        }
+    }
+
+  FREE_ARRAY (F);
+
+  // Partitioning read the offsets back, so the longest row is known.
+  partition_csr (M);
+  int max_length = 0;
+  for (int row = 0; row < M->rows; row++)
+    {
+      int length = M->offsets.ints[row + 1] - M->offsets.ints[row];
+      max_length = length > max_length ? length : max_length;
+    }
+  if (max_length > 1 && max_length <= BATCHED_SORT_MAX_LENGTH)
+    {
+      batched_sort ("a < b", M->columns, &M->values, &M->offsets,
+                    max_length, &partials[event_count++]);
+    }
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
+
+/*
+** Products with a vector take its elements as a single column, whatever the
+** dimensions of the arrays holding them.
+*/
+static unsigned long long
+sparse_product (const char *op1, const char *op2, csr_matrix A, array B,
+                array C, int n, cl_event *event)
+{
+  csr_matrix P = A;
+  if (!A.blocks.device)
+    {
+      P.blocks.device = NULL;
+      partition_csr (&P);
+    }
+  if (!P.blocks.device)
+    return 0;
+  int blocks = P.blocks.dim2;
+
+  const char *ctype = TYPE_STR_FROM_ENUM (C.type);
+  char *src = get_spmm (TYPE_STR_FROM_ENUM (A.values.type),
+                        TYPE_STR_FROM_ENUM (B.type), ctype, op1, op2,
+                        SPARSE_BLOCK_NNZ);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+
+  // Chunks of split rows write one row of partials each.
+  int splits = 0;
+  for (int b = 0; b < blocks; b++)
+    {
+      int *block = P.blocks.ints + b * SPARSE_BLOCK_FIELDS;
+      splits |= block[0] == block[1];
+    }
+  array partial_products = C;
+  if (splits)
+    partial_products = alloc_array (C.type, CL_MEM_READ_WRITE, n, blocks, 1);
+
+  int idx = set_kernel_args (kernel, 7, A.offsets, A.columns, A.values,
+                             P.blocks, B, C, partial_products);
+  CHECK_CL (clSetKernelArg (kernel, idx, sizeof (int), &n));
+
+  cl_event partials[2];
+  int event_count = 0;
+  size_t local_size[] = { SPARSE_BLOCK_NNZ, 1 };
+  size_t global_size[] = { blocks * local_size[0], n };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 2, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    &partials[event_count++]));
+
+  if (splits)
+    {
+      char *src_combine = get_spmm_combine (ctype, op1);
+      cl_kernel kernel_combine = TRY_COMPILE_KERNEL (src_combine);
+      free (src_combine);
+      int combine_idx = SET_KERNEL_ARGS (kernel_combine, P.blocks,
+                                         partial_products, C);
+      CHECK_CL (
+          clSetKernelArg (kernel_combine, combine_idx, sizeof (int), &n));
+
+      size_t combine_local_size[] = { _tile_size, 1 };
+      size_t combine_global_size[] = { LOWEST_MULTIPLE_OF_TILE (blocks), n };
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel_combine, 2, NULL,
+                                        combine_global_size,
+                                        combine_local_size, 0, NULL,
+                                        &partials[event_count++]));
+      FREE_ARRAY (partial_products);
+    }
+  if (!A.blocks.device)
+    FREE_ARRAY (P.blocks);
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
+
+unsigned long long
+spmm (const char *op1, const char *op2, csr_matrix A, array B, array C,
+      cl_event *event)
+{
+  if (B.dim2 != A.cols || C.dim2 != A.rows || C.dim1 != B.dim1
+      || B.dim3 != 1 || C.dim3 != 1)
+    {
+      handle_error ("Cannot multiply %dx%d sparse matrix by %dx%d into %dx%d",
+                    A.rows, A.cols, B.dim2, B.dim1, C.dim2, C.dim1);
+      return 0;
+    }
+
+  return sparse_product (op1, op2, A, B, C, C.dim1, event);
+}
+
+unsigned long long
+spmv (const char *op1, const char *op2, csr_matrix A, array x, array y,
+      cl_event *event)
+{
+  if (ARRAY_SIZE (x) != A.cols || ARRAY_SIZE (y) != A.rows)
+    {
+      handle_error ("Cannot multiply %dx%d sparse matrix by vector of %d "
+                    "into vector of %d",
+                    A.rows, A.cols, ARRAY_SIZE (x), ARRAY_SIZE (y));
+      return 0;
+    }
+
+  return sparse_product (op1, op2, A, x, y, 1, event);
+}
@@ -0,0 +1,243 @@
+/**
+ * @file sparse.h
+ */
+
+#ifndef SPARSE_H_
+#define SPARSE_H_
+
+#include "cl_utils.h"
+
+/**
+ * @brief Nonzeros staged in local memory per work group, can be overriden.
+ *
+ * Sparse products give each work group either a run of short rows holding at
+ * most this many nonzeros, or a single longer row. Also the work group size,
+ * so it must not exceed the device's maximum.
+ */
+#ifndef SPARSE_BLOCK_NNZ
+#define SPARSE_BLOCK_NNZ 256
+#endif
+
+/**
+ * @struct csr_matrix
+ * @brief Sparse matrix in compressed sparse row format.
+ *
+ * Made of @ref array "arrays": the int offsets of the first nonzero of each
+ * row followed by the number of nonzeros, and the int column index and value
+ * of each nonzero, stored row after row. Blocks partition the rows into the
+ * work groups of sparse products, see @ref partition_csr.
+ */
+typedef struct
+{
+  int rows, cols;
+  array offsets; /**< int offsets into columns and values, rows + 1. */
+  array columns; /**< int column of each nonzero. */
+  array values;  /**< Value of each nonzero. */
+  array blocks;  /**< int row blocks, empty until partitioned. */
+} csr_matrix;
+
+/**
+ * @brief Allocate new @ref csr_matrix.
+ *
+ * Allocates the offsets, columns and values of a matrix with the given
+ * number of nonzeros, leaving it unpartitioned.
+ *
+ * @param type @ref array_type "Type" of the values.
+ * @param flags Flags for the device-side buffers.
+ * @param rows Number of rows.
+ * @param cols Number of columns.
+ * @param nnz Number of nonzeros.
+ * @return New @ref csr_matrix.
+ */
+csr_matrix alloc_csr (array_type type, cl_mem_flags flags, int rows, int cols,
+                      int nnz);
+#define ALLOC_CSR(type, flags, rows, cols, nnz)                               \
+  alloc_csr ((array_type)TYPE_TO_ENUM (type), flags, rows, cols,              \
+             nnz) /**< @copydoc alloc_csr */
+
+/**
+ * @brief Free a @ref csr_matrix.
+ *
+ * Frees every @ref array of the matrix, including its blocks if partitioned.
+ *
+ * @param M @ref csr_matrix to free.
+ */
+void free_csr (csr_matrix M);
+#define FREE_CSR(M) free_csr (M) /**< @copydoc free_csr */
+
+/**
+ * @brief Partition the rows of a @ref csr_matrix into blocks.
+ *
+ * Reads the offsets back from the device and groups consecutive rows into
+ * blocks of at most SPARSE_BLOCK_NNZ nonzeros, one per work group of sparse
+ * products. Longer rows get a block each, and rows much longer than that are
+ * split over several blocks whose partial results are reduced by a second
+ * pass, so a few dense rows of a power-law matrix do not hold back the rest.
+ * Must be called again whenever the offsets change. Blocks, since the
+ * offsets are read back to the host.
+ *
+ * @param M Pointer to the @ref csr_matrix to partition.
+ */
+void partition_csr (csr_matrix *M);
+#define PARTITION_CSR(M) partition_csr (&(M)) /**< @copydoc partition_csr */
+
+extern const char *_coo_to_csr_fmt;
+extern const char *_spmm_fmt;
+extern const char *_spmm_combine_fmt;
+/**
+ * @brief Composes COO to CSR conversion kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * With the phase argument 0, counts the entries of each row given in R into
+ * the following element of F. With phase 1, moves the columns C and values V
+ * of each entry to the next free position of its row in I and W, starting
+ * from the offsets O and counting positions taken in F.
+ *
+ * @param vtype String for type of third @ref array of kernel: V.
+ * @param wtype String for type of seventh @ref array of kernel: W.
+ * @return Pointer to null-terminated string.
+ */
+char *get_coo_to_csr (const char *vtype, const char *wtype);
+/**
+ * @brief Composes sparse matrix product kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Each work group takes one block of the row blocks R. Blocks of several
+ * rows stage the op2 of their nonzeros and B in local memory, then each work
+ * item reduces one row by op1. Blocks of a single row, or of a chunk of one,
+ * are reduced by the whole work group in a tree, chunks writing into the
+ * partials P rather than into C. Reductions start from the first nonzero
+ * rather than an identity element, so any semiring can be used.
+ *
+ * @param vtype String for type of values of the matrix.
+ * @param btype String for type of dense @ref array of kernel: B.
+ * @param ctype String for type of output @ref array of kernel: C.
+ * @param op1 String for the reducing operation the kernel performs.
+ * @param op2 String for the pairwise operation the kernel performs.
+ * @param local_size Work group size, and nonzeros staged per work group.
+ * @return Pointer to null-terminated string.
+ */
+char *get_spmm (const char *vtype, const char *btype, const char *ctype,
+                const char *op1, const char *op2, int local_size);
+/**
+ * @brief Composes sparse matrix product combine kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * For each row split over several blocks of R, reduces by op1 the partials
+ * of its blocks in P into its row of C.
+ *
+ * @param ctype String for type of @ref array "arrays" of kernel: P and C.
+ * @param op1 String for the reducing operation the kernel performs.
+ * @return Pointer to null-terminated string.
+ */
+char *get_spmm_combine (const char *ctype, const char *op1);
+/**
+ * @brief Perform COO to CSR conversion.
+ *
+ * Builds M from the nonzeros given in coordinate format by their int rows R,
+ * int columns C and values V, in any order, on the device. M must have been
+ * allocated with as many nonzeros as R has elements. Duplicates are kept.
+ * Nonzeros are sorted by column within each row when no row is longer than
+ * BATCHED_SORT_MAX_LENGTH, and in undefined order otherwise. M is
+ * partitioned as by @ref partition_csr, which blocks until the offsets are
+ * known. Attempts to record timing if no cl_event is provided, non blocking
+ * otherwise.
+ *
+ * @param R @ref array of int rows of the nonzeros.
+ * @param C @ref array of int columns of the nonzeros.
+ * @param V @ref array of values of the nonzeros.
+ * @param M Pointer to the @ref csr_matrix to build.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * csr_matrix M = ALLOC_CSR (float, CL_MEM_READ_WRITE, rows, cols, R.dim1);
+ * COO_TO_CSR(R, C, V, M);
+ * @endcode
+ */
+unsigned long long coo_to_csr (array R, array C, array V, csr_matrix *M,
+                               cl_event *event);
+#define _COO_TO_CSR_ONE(R, C, V, M) coo_to_csr (R, C, V, &(M), NULL);
+#define _COO_TO_CSR_TWO(R, C, V, M, event) coo_to_csr (R, C, V, &(M), event)
+#define COO_TO_CSR(...)                                                       \
+  _GETM_FIVE (__VA_ARGS__, _COO_TO_CSR_TWO, _COO_TO_CSR_ONE) (                \
+      __VA_ARGS__) /**< @copydoc coo_to_csr*/
+/**
+ * @brief Perform sparse matrix dense matrix product.
+ *
+ * Writes into C the product of the sparse matrix A and the dense matrix B,
+ * reducing by op1 the op2 of each nonzero of a row of A and the element of B
+ * in its column, like @ref inner_product. B has as many rows as A has
+ * columns, and C as many rows as A, both with the same number of columns.
+ * Rows of A without nonzeros leave their row of C untouched, since
+ * reductions have no identity element. A is partitioned on every call unless
+ * @ref partition_csr was called beforehand. Blocks and attempts to record
+ * timing if no cl_event is provided, non blocking otherwise.
+ *
+ * @param op1 String for the reducing operation.
+ * @param op2 String for the pairwise operation.
+ * @param A @ref csr_matrix to multiply.
+ * @param B Dense @ref array to multiply.
+ * @param C @ref array to write the product into.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Ordinary product
+ * SPMM("+", "*", A, B, C);
+ * // Shortest paths of one more hop from several sources
+ * cl_event event;
+ * SPMM("min", "+", A, D, D_next, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long spmm (const char *op1, const char *op2, csr_matrix A,
+                         array B, array C, cl_event *event);
+#define _SPMM_ONE(op1, op2, A, B, C) spmm (op1, op2, A, B, C, NULL);
+#define _SPMM_TWO(op1, op2, A, B, C, event) spmm (op1, op2, A, B, C, event)
+#define SPMM(...)                                                             \
+  _GETM_SIX (__VA_ARGS__, _SPMM_TWO, _SPMM_ONE) (                             \
+      __VA_ARGS__) /**< @copydoc spmm*/
+/**
+ * @brief Perform sparse matrix vector product.
+ *
+ * Same as @ref spmm with a single column, but taking x and y as vectors of
+ * as many elements as A has columns and rows respectively, whatever their
+ * dimensions.
+ *
+ * @param op1 String for the reducing operation.
+ * @param op2 String for the pairwise operation.
+ * @param A @ref csr_matrix to multiply.
+ * @param x @ref array of the vector to multiply.
+ * @param y @ref array to write the product into.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * SPMV("+", "*", A, x, y);
+ * @endcode
+ */
+unsigned long long spmv (const char *op1, const char *op2, csr_matrix A,
+                         array x, array y, cl_event *event);
+#define _SPMV_ONE(op1, op2, A, x, y) spmv (op1, op2, A, x, y, NULL);
+#define _SPMV_TWO(op1, op2, A, x, y, event) spmv (op1, op2, A, x, y, event)
+#define SPMV(...)                                                             \
+  _GETM_SIX (__VA_ARGS__, _SPMV_TWO, _SPMV_ONE) (                             \
+      __VA_ARGS__) /**< @copydoc spmv*/
+
+#endif // SPARSE_H_
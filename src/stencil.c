@@ -0,0 +1,200 @@
+#include "stencil.h"
+#include "cl_utils.h"
+#include <stdio.h>
+
+/*
+** Neighbours are read from the tile in local memory through a macro, which
+** has to sit on its own line ahead of the kernel.
+*/
+static const char *_stencil_accessor
+    = "\n#define A(di, dj, dk) A_tile[((h3 + (h3 ? (dk) : 0)) * ext2"
+      " + local_j + h2 + (h2 ? (dj) : 0)) * ext1"
+      " + local_i + h1 + (h1 ? (di) : 0)]\n";
+
+/* Format strings:
+** 1. accessor macro
+** 2. boundary
+** 3. A type
+** 4. B type
+** 5. halo1
+** 6. halo2
+** 7. halo3
+** 8. tile1
+** 9. tile2
+** 10. A_tile type
+** 11. A type
+** 12. a type
+** 13. b type
+** 14. OP1
+*/
+const char *_stencil_fmt = RAW (
+    % s
+
+    int stencil_index (int x, int n) {
+      const int boundary = % d;
+      if (x >= 0 && x < n)
+        {
+          return x;
+        }
+      switch (boundary)
+        {
+        case 0:
+          return clamp (x, 0, n - 1);
+        case 1:
+          return -1;
+        case 2:
+          while (x < 0)
+            x += n;
+          while (x >= n)
+            x -= n;
+          return x;
+        default:
+          if (n == 1)
+            {
+              return 0;
+            }
+          while (x < 0 || x >= n)
+            x = x < 0 ? -x : 2 * n - 2 - x;
+          return x;
+        }
+    }
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int b1, const int b2, const int b3, __global % s * B) {
+      int i = get_global_id (0);
+      int j = get_global_id (1);
+      int k = get_global_id (2);
+      int local_i = get_local_id (0);
+      int local_j = get_local_id (1);
+      int local_id = local_j * get_local_size (0) + local_i;
+      int local_size = get_local_size (0) * get_local_size (1);
+
+      const int h1 = % d;
+      const int h2 = % d;
+      const int h3 = % d;
+      const int ext1 = % d + 2 * h1;
+      const int ext2 = % d + 2 * h2;
+      const int ext3 = 1 + 2 * h3;
+      __local % s A_tile[ext1 * ext2 * ext3];
+
+      int i0 = get_group_id (0) * get_local_size (0) - h1;
+      int j0 = get_group_id (1) * get_local_size (1) - h2;
+      for (int t = local_id; t < ext1 * ext2 * ext3; t += local_size)
+        {
+          int z = t / (ext1 * ext2);
+          int y = (t - z * ext1 * ext2) / ext1;
+          int x = t - (z * ext2 + y) * ext1;
+          int ti = stencil_index (i0 + x, a1);
+          int tj = stencil_index (j0 + y, a2);
+          int tk = stencil_index (k - h3 + z, a3);
+          A_tile[t] = (ti < 0 || tj < 0 || tk < 0)
+                          ? 0
+                          : A[(tk * a2 + tj) * a1 + ti];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      if (i < b1 && j < b2 && k < b3)
+        {
+          int global_id = (k * b2 + j) * b1 + i;
+          % s a = A (0, 0, 0);
+          % s b = B[global_id];
+          B[global_id] = % s;
+        }
+    });
+
+char *
+get_stencil (const char *atype, const char *btype, const char *op1,
+             stencil_boundary boundary, int tile1, int tile2, int halo1,
+             int halo2, int halo3)
+{
+  int size = snprintf (NULL, 0, _stencil_fmt, _stencil_accessor, boundary,
+                       atype, btype, halo1, halo2, halo3, tile1, tile2, atype,
+                       atype, btype, op1);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _stencil_fmt, _stencil_accessor,
+                        boundary, atype, btype, halo1, halo2, halo3, tile1,
+                        tile2, atype, atype, btype, op1);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+stencil (const char *op1, int radius, stencil_boundary boundary, array A,
+         array B, cl_event *event)
+{
+  cl_event _event;
+  if (A.dim1 != B.dim1 || A.dim2 != B.dim2 || A.dim3 != B.dim3)
+    {
+      handle_error ("Stencil of %dx%dx%d array onto %dx%dx%d array", A.dim1,
+                    A.dim2, A.dim3, B.dim1, B.dim2, B.dim3);
+      return 0;
+    }
+  if (radius < 0)
+    {
+      handle_error ("Stencil radius %d is negative", radius);
+      return 0;
+    }
+
+  // Group along the dimensions longer than 1, a whole tile's worth if only
+  // one of the first two is, and one plane at a time along the third.
+  size_t local_size[]
+      = { A.dim1 > 1 ? _tile_size : 1, A.dim2 > 1 ? _tile_size : 1, 1 };
+  if (local_size[0] * local_size[1] == (size_t)_tile_size)
+    local_size[A.dim1 > 1 ? 0 : 1] *= _tile_size;
+  int halo1 = A.dim1 > 1 ? radius : 0;
+  int halo2 = A.dim2 > 1 ? radius : 0;
+  int halo3 = A.dim3 > 1 ? radius : 0;
+
+  cl_ulong local_mem_size;
+  CHECK_CL (clGetDeviceInfo (_device, CL_DEVICE_LOCAL_MEM_SIZE,
+                             sizeof (local_mem_size), &local_mem_size, NULL));
+  size_t tile_bytes = (local_size[0] + 2 * halo1)
+                      * (local_size[1] + 2 * halo2) * (1 + 2 * halo3)
+                      * A.membsize;
+  if (tile_bytes > local_mem_size)
+    {
+      handle_error ("Stencil radius %d needs %zu bytes of local memory, "
+                    "device has %lu",
+                    radius, tile_bytes, (unsigned long)local_mem_size);
+      return 0;
+    }
+
+  char *src = get_stencil (TYPE_STR_FROM_ENUM (A.type),
+                           TYPE_STR_FROM_ENUM (B.type), op1, boundary,
+                           local_size[0], local_size[1], halo1, halo2, halo3);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  SET_KERNEL_ARGS (kernel, A, B);
+
+  size_t global_size[] = { B.dim1, B.dim2, B.dim3 };
+  for (int d = 0; d < 2; d++)
+    {
+      global_size[d] = ((global_size[d] + local_size[d] - 1) / local_size[d])
+                       * local_size[d];
+    }
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                    local_size, 0, NULL,
+                                    event ? event : &_event));
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file stencil.h
+ */
+
+#ifndef STENCIL_H_
+#define STENCIL_H_
+
+#include "cl_utils.h"
+
+/**
+ * @brief Enum representing how a stencil reads past the edges of an array.
+ */
+typedef enum
+{
+  STENCIL_CLAMP,  /**< Repeat the nearest edge element. */
+  STENCIL_ZERO,   /**< Read zero. */
+  STENCIL_WRAP,   /**< Wrap around to the opposite edge. */
+  STENCIL_MIRROR, /**< Reflect about the edge element, without repeating it. */
+} stencil_boundary;
+
+extern const char *_stencil_fmt;
+/**
+ * @brief Composes stencil kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the second input argument B, the result of evaluating the operation is
+ * written for each index. Each work group stages its tile of A, plus a halo
+ * of the given width along each dimension, in local memory, from which
+ * `A(di, dj, dk)` reads the element of A offset from the current index.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param btype String for type of second @ref array of kernel: B.
+ * @param op1 String for the operation the kernel maps.
+ * @param boundary @ref stencil_boundary for reads past the edges of A.
+ * @param tile1 Work group size along the first dimension.
+ * @param tile2 Work group size along the second dimension.
+ * @param halo1 Halo width along the first dimension.
+ * @param halo2 Halo width along the second dimension.
+ * @param halo3 Halo width along the third dimension.
+ * @return Pointer to null-terminated string.
+ */
+char *get_stencil (const char *atype, const char *btype, const char *op1,
+                   stencil_boundary boundary, int tile1, int tile2, int halo1,
+                   int halo2, int halo3);
+/**
+ * @brief Perform stencil operation.
+ *
+ * Like @ref map, but the operation may also read the neighbours of the current
+ * index in A as `A(di, dj, dk)`, with every offset within the given radius.
+ * Offsets along dimensions of A of size 1 are ignored. A and B must have the
+ * same dimensions, and should not be the same @ref array. Blocks and attempts
+ * to record timing if no cl_event is provided, non blocking otherwise.
+ *
+ * @param op1 String of operation to map.
+ * @param radius Largest offset read along any dimension.
+ * @param boundary @ref stencil_boundary for reads past the edges of A.
+ * @param A First argument @ref array of the kernel.
+ * @param B Second argument @ref array of the kernel.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * Within the scope of the operation `a` and `b` hold the values of A and B at
+ * the current index, `i`, `j` and `k` its position along each dimension, and
+ * `A(di, dj, dk)` the value of A at the position offset by di, dj and dk.
+ * @code
+ * // 3x3 box blur of an image, repeating edge pixels
+ * STENCIL("(A(-1, -1, 0) + A(0, -1, 0) + A(1, -1, 0)"
+ *         " + A(-1, 0, 0) + a + A(1, 0, 0)"
+ *         " + A(-1, 1, 0) + A(0, 1, 0) + A(1, 1, 0)) / 9",
+ *         1, STENCIL_CLAMP, image, blurred);
+ * // Jacobi iteration of the Laplace equation on a torus
+ * cl_event event;
+ * STENCIL("(A(-1, 0, 0) + A(1, 0, 0) + A(0, -1, 0) + A(0, 1, 0)) / 4",
+ *         1, STENCIL_WRAP, U, U_next, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long stencil (const char *op1, int radius,
+                            stencil_boundary boundary, array A, array B,
+                            cl_event *event);
+#define _STENCIL_ONE(op1, radius, boundary, A, B)                             \
+  stencil (op1, radius, boundary, A, B, NULL);
+#define _STENCIL_TWO(op1, radius, boundary, A, B, event)                      \
+  stencil (op1, radius, boundary, A, B, event)
+#define STENCIL(...)                                                          \
+  _GETM_SIX (__VA_ARGS__, _STENCIL_TWO,                                       \
+             _STENCIL_ONE) (__VA_ARGS__) /**< @copydoc stencil*/
+
+#endif // STENCIL_H_
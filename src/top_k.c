@@ -0,0 +1,373 @@
+#include "top_k.h"
+#include "batched_sort.h"
+#include "cl_utils.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+** Keys are mapped onto unsigned integers ordered like the original values, and
+** radix select finds the k'th largest key one digit of TOP_K_DIGIT_BITS at a
+** time. Each row keeps its state in S: the low and high words of the selected
+** key prefix, the number of keys still to select within the prefix, and two
+** output counters. Digits must divide every key width.
+*/
+#define TOP_K_DIGIT_BITS 8
+#define TOP_K_RADIX (1 << TOP_K_DIGIT_BITS)
+#define TOP_K_STATE 8
+#define TOP_K_ITEMS_PER_WORK_ITEM 16
+
+/* Format strings:
+** 1. key type
+** 2. A type
+** 3. key body
+** 4. A type
+** 5. TOP_K_DIGIT_BITS
+** 6. TOP_K_RADIX
+*/
+const char *_top_k_histogram_fmt = RAW (
+    typedef % s radix_t;
+
+    radix_t key_of (% s x) { % s }
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int h1, const int h2, const int h3, __global int *H,
+        const int s1, const int s2, const int s3, __global const int *S,
+        const int shift) {
+      int row = get_global_id (1);
+      int local_id = get_local_id (0);
+      int local_size = get_local_size (0);
+      const int nbits = sizeof (radix_t) * 8;
+      const int bits = % d;
+      const int radix = % d;
+      __local int hist[radix];
+
+      for (int b = local_id; b < radix; b += local_size)
+        {
+          hist[b] = 0;
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      radix_t prefix = (radix_t)(((ulong)(uint)S[row * s1 + 1] << 32)
+                                 | (uint)S[row * s1]);
+      for (int i = get_global_id (0); i < a1; i += get_global_size (0))
+        {
+          radix_t key = key_of (A[row * a1 + i]);
+          if (shift + bits >= nbits
+              || ((key ^ prefix) >> (shift + bits)) == 0)
+            {
+              atomic_inc (&hist[(key >> shift) & (radix - 1)]);
+            }
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      for (int b = local_id; b < radix; b += local_size)
+        {
+          if (hist[b])
+            {
+              atomic_add (&H[row * h1 + b], hist[b]);
+            }
+        }
+    });
+
+/* Format strings:
+** 1. key type
+** 2. TOP_K_RADIX
+*/
+const char *_top_k_select_fmt = RAW (
+    typedef % s radix_t;
+
+    __kernel void entry (
+        const int h1, const int h2, const int h3, __global int *H,
+        const int s1, const int s2, const int s3, __global int *S,
+        const int shift) {
+      int row = get_global_id (0);
+      const int radix = % d;
+
+      if (row < s2 * s3)
+        {
+          int remaining = S[row * s1 + 2];
+          int digit = -1;
+          for (int b = radix - 1; b >= 0; b--)
+            {
+              int count = H[row * h1 + b];
+              H[row * h1 + b] = 0;
+              if (digit < 0 && count >= remaining)
+                {
+                  digit = b;
+                }
+              else if (digit < 0)
+                {
+                  remaining -= count;
+                }
+            }
+
+          radix_t prefix = (radix_t)(((ulong)(uint)S[row * s1 + 1] << 32)
+                                     | (uint)S[row * s1]);
+          prefix |= (radix_t)max (digit, 0) << shift;
+          S[row * s1] = (int)(uint)prefix;
+          S[row * s1 + 1] = (int)(uint)((ulong)prefix >> 32);
+          S[row * s1 + 2] = remaining;
+        }
+    });
+
+/* Format strings:
+** 1. key type
+** 2. A type
+** 3. key body
+** 4. A type
+** 5. V type
+** 6. x type
+*/
+const char *_top_k_gather_fmt = RAW (
+    typedef % s radix_t;
+
+    radix_t key_of (% s x) { % s }
+
+    __kernel void entry (
+        const int a1, const int a2, const int a3, __global const % s * A,
+        const int v1, const int v2, const int v3, __global % s * V,
+        const int i1, const int i2, const int i3, __global int *I,
+        const int s1, const int s2, const int s3, __global int *S) {
+      int row = get_global_id (1);
+
+      radix_t threshold = (radix_t)(((ulong)(uint)S[row * s1 + 1] << 32)
+                                    | (uint)S[row * s1]);
+      int remaining = S[row * s1 + 2];
+      for (int i = get_global_id (0); i < a1; i += get_global_size (0))
+        {
+          % s x = A[row * a1 + i];
+          radix_t key = key_of (x);
+          int pos = -1;
+          if (key > threshold)
+            {
+              pos = atomic_inc (&S[row * s1 + 3]);
+            }
+          else if (key == threshold)
+            {
+              pos = atomic_inc (&S[row * s1 + 4]);
+              pos = pos < remaining ? v1 - remaining + pos : -1;
+            }
+
+          if (pos >= 0)
+            {
+              V[row * v1 + pos] = x;
+              I[row * i1 + pos] = i;
+            }
+        }
+    });
+
+static const char *
+get_top_k_key (array_type type, const char **ktype, int *nbits)
+{
+  *ktype = "uint";
+  *nbits = 32;
+  switch (type)
+    {
+    case TYPE_FLOAT:
+      return "uint u = as_uint (x); "
+             "return u ^ ((u >> 31) ? 0xFFFFFFFFu : 0x80000000u);";
+    case TYPE_DOUBLE:
+      *ktype = "ulong";
+      *nbits = 64;
+      return "ulong u = as_ulong (x); "
+             "return u ^ ((u >> 63) ? 0xFFFFFFFFFFFFFFFFul "
+             ": 0x8000000000000000ul);";
+    case TYPE_CHAR:
+    case TYPE_SHORT:
+    case TYPE_INT:
+      return "return (uint)(int)x ^ 0x80000000u;";
+    case TYPE_LONG:
+      *ktype = "ulong";
+      *nbits = 64;
+      return "return (ulong)x ^ 0x8000000000000000ul;";
+    case TYPE_BOOL:
+      return "return (uint)x;";
+    default:
+      handle_error ("Unimplemented element type for top-k selection");
+      return "return 0;";
+    }
+}
+
+char *
+get_top_k_histogram (const char *atype, const char *ktype, const char *key)
+{
+  int size = snprintf (NULL, 0, _top_k_histogram_fmt, ktype, atype, key, atype,
+                       TOP_K_DIGIT_BITS, TOP_K_RADIX);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _top_k_histogram_fmt, ktype, atype,
+                        key, atype, TOP_K_DIGIT_BITS, TOP_K_RADIX);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+char *
+get_top_k_select (const char *ktype)
+{
+  int size = snprintf (NULL, 0, _top_k_select_fmt, ktype, TOP_K_RADIX);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count
+      = snprintf (kernel, size + 1, _top_k_select_fmt, ktype, TOP_K_RADIX);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+char *
+get_top_k_gather (const char *atype, const char *ktype, const char *key)
+{
+  int size = snprintf (NULL, 0, _top_k_gather_fmt, ktype, atype, key, atype,
+                       atype, atype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _top_k_gather_fmt, ktype, atype, key,
+                        atype, atype, atype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+top_k (array A, array V, array I, cl_event *event)
+{
+  int k = V.dim1;
+  int rows = A.dim2 * A.dim3;
+  if (k < 1 || k > A.dim1)
+    {
+      handle_error ("Cannot select top %d of rows of length %d", k, A.dim1);
+      return 0;
+    }
+  if (I.type != TYPE_INT)
+    {
+      handle_error ("Top-k indices must be an array of int");
+      return 0;
+    }
+  if (V.type != A.type)
+    {
+      handle_error ("Top-k values must be an array of %s, got %s",
+                    TYPE_STR_FROM_ENUM (A.type), TYPE_STR_FROM_ENUM (V.type));
+      return 0;
+    }
+  if (I.dim1 != V.dim1 || V.dim2 * V.dim3 != rows
+      || I.dim2 * I.dim3 != rows)
+    {
+      handle_error ("Top %d of %d rows need %dx%d values and indices, got "
+                    "%dx%d and %dx%d",
+                    k, rows, k, rows, V.dim1, V.dim2 * V.dim3, I.dim1,
+                    I.dim2 * I.dim3);
+      return 0;
+    }
+
+  const char *atype = TYPE_STR_FROM_ENUM (A.type);
+  const char *ktype;
+  int nbits;
+  const char *key = get_top_k_key (A.type, &ktype, &nbits);
+
+  array H = ALLOC_ARRAY (int, CL_MEM_READ_WRITE, TOP_K_RADIX, rows);
+  array S = ALLOC_ARRAY (int, CL_MEM_READ_WRITE, TOP_K_STATE, rows);
+  memset (H.host, 0, ARRAY_SIZE (H) * H.membsize);
+  memset (S.host, 0, ARRAY_SIZE (S) * S.membsize);
+  for (int row = 0; row < rows; row++)
+    {
+      S.ints[row * TOP_K_STATE + 2] = k;
+    }
+  SYNC_ARRAY_TO_DEVICE (H);
+  SYNC_ARRAY_TO_DEVICE (S);
+
+  char *src_histogram = get_top_k_histogram (atype, ktype, key);
+  cl_kernel kernel_histogram = TRY_COMPILE_KERNEL (src_histogram);
+  free (src_histogram);
+  int histogram_idx = SET_KERNEL_ARGS (kernel_histogram, A, H, S);
+
+  char *src_select = get_top_k_select (ktype);
+  cl_kernel kernel_select = TRY_COMPILE_KERNEL (src_select);
+  free (src_select);
+  int select_idx = SET_KERNEL_ARGS (kernel_select, H, S);
+
+  char *src_gather = get_top_k_gather (atype, ktype, key);
+  cl_kernel kernel_gather = TRY_COMPILE_KERNEL (src_gather);
+  free (src_gather);
+  set_kernel_args (kernel_gather, 4, A, V, I, S);
+
+  size_t local_size[] = { _tile_size * _tile_size, 1 };
+  size_t groups = (A.dim1 + TOP_K_ITEMS_PER_WORK_ITEM * local_size[0] - 1)
+                  / (TOP_K_ITEMS_PER_WORK_ITEM * local_size[0]);
+  size_t global_size[] = { groups * local_size[0], rows };
+  size_t select_global_size[] = { LOWEST_MULTIPLE_OF_TILE (rows) };
+  size_t select_local_size[] = { _tile_size };
+
+  cl_event partials[BUFSIZE];
+  int event_count = 0;
+  for (int shift = nbits - TOP_K_DIGIT_BITS; shift >= 0;
+       shift -= TOP_K_DIGIT_BITS)
+    {
+      CHECK_CL (clSetKernelArg (kernel_histogram, histogram_idx, sizeof (int),
+                                &shift));
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel_histogram, 2, NULL,
+                                        global_size, local_size, 0, NULL,
+                                        &partials[event_count++]));
+
+      CHECK_CL (
+          clSetKernelArg (kernel_select, select_idx, sizeof (int), &shift));
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel_select, 1, NULL,
+                                        select_global_size, select_local_size,
+                                        0, NULL, &partials[event_count++]));
+    }
+
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel_gather, 2, NULL,
+                                    global_size, local_size, 0, NULL,
+                                    &partials[event_count++]));
+
+  if (k <= BATCHED_SORT_MAX_LENGTH)
+    {
+      batched_sort ("a > b", V, &I, NULL, 0, &partials[event_count++]);
+    }
+
+  FREE_ARRAY (H);
+  FREE_ARRAY (S);
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file top_k.h
+ */
+
+#ifndef TOP_K_H_
+#define TOP_K_H_
+
+#include "cl_utils.h"
+
+extern const char *_top_k_histogram_fmt;
+extern const char *_top_k_select_fmt;
+extern const char *_top_k_gather_fmt;
+/**
+ * @brief Composes radix select histogram kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * For each row of A, counts into H the digits at the bit offset given by the
+ * shift argument of the keys matching the prefix selected so far in S. Each
+ * work group counts into a private histogram in local memory before merging.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param ktype String for the unsigned type keys are mapped onto.
+ * @param key String for the body of the function mapping `x` onto its key.
+ * @return Pointer to null-terminated string.
+ */
+char *get_top_k_histogram (const char *atype, const char *ktype,
+                           const char *key);
+/**
+ * @brief Composes radix select digit selection kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * For each row, picks from the histogram H the digit holding the k'th largest
+ * key, appends it to the prefix in S, and clears the histogram.
+ *
+ * @param ktype String for the unsigned type keys are mapped onto.
+ * @return Pointer to null-terminated string.
+ */
+char *get_top_k_select (const char *ktype);
+/**
+ * @brief Composes top-k gather kernel.
+ *
+ * Constructs the kernel with the specified types, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * For each row of A, writes into V and I the values and indices of the keys
+ * greater than the selected key in S, and as many keys equal to it as needed
+ * to make up the row of V.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param ktype String for the unsigned type keys are mapped onto.
+ * @param key String for the body of the function mapping `x` onto its key.
+ * @return Pointer to null-terminated string.
+ */
+char *get_top_k_gather (const char *atype, const char *ktype,
+                        const char *key);
+/**
+ * @brief Perform top-k selection.
+ *
+ * Selects the k largest elements of each row of A, where k is the first
+ * dimension of V, without sorting A. Writes their values into V, of the type
+ * of A, and their column indices into the int @ref array I, both with one row
+ * of k elements per row of A. Rows of results are sorted in descending order
+ * when k is at most BATCHED_SORT_MAX_LENGTH, and in undefined order
+ * otherwise. Ties with the k'th largest value are broken arbitrarily. Blocks
+ * and attempts to record timing if no cl_event is provided, non blocking
+ * otherwise.
+ *
+ * @param A @ref array to select from.
+ * @param V @ref array to write the selected values into.
+ * @param I @ref array of int to write the selected indices into.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Ten highest scores of a whole array, and their positions
+ * array V = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, 10);
+ * array I = ALLOC_ARRAY (int, CL_MEM_READ_WRITE, 10);
+ * TOP_K(scores, V, I);
+ * // Ten highest scores of each row of a batch
+ * cl_event event;
+ * array BV = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, 10, batch.dim2);
+ * array BI = ALLOC_ARRAY (int, CL_MEM_READ_WRITE, 10, batch.dim2);
+ * TOP_K(batch, BV, BI, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long top_k (array A, array V, array I, cl_event *event);
+#define _TOP_K_ONE(A, V, I) top_k (A, V, I, NULL);
+#define _TOP_K_TWO(A, V, I, event) top_k (A, V, I, event)
+#define TOP_K(...)                                                            \
+  _GETM_FOUR (__VA_ARGS__, _TOP_K_TWO, _TOP_K_ONE) (                          \
+      __VA_ARGS__) /**< @copydoc top_k*/
+
+#endif // TOP_K_H_
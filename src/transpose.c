@@ -2,44 +2,252 @@
 #include "cl_utils.h"
 #include <stdio.h>
 
+/*
+** Elements moved by each work item, along rows of the tile when the fast
+** axis moves and along the fast axis otherwise.
+*/
+#define TRANSPOSE_WORK_PER_THREAD 4
+
 /* Format strings:
 ** 1. A type
 ** 2. B type
 ** 3. TILE_SIZE
-** 4. A_tile type
+** 4. work per thread
+** 5. fast axis
+** 6. A_tile type
 */
 const char *_transpose_fmt = RAW (__kernel void entry (
     const int a1, const int a2, const int a3, __global const % s * A,
-    const int b1, const int b2, const int b3, __global % s * B) {
-  int row = get_global_id (1);
-  int col = get_global_id (0);
-
+    const int b1, const int b2, const int b3, __global % s * B,
+    const int bs0, const int bs1, const int bs2) {
   int local_row = get_local_id (1);
   int local_col = get_local_id (0);
   const int tile_size = % d;
+  const int wpt = % d;
+  const int p = % d;
+  const int rows = tile_size / wpt;
+
+  // Tiles span the fast axis of A and axis p of A, which becomes the fast
+  // axis of B, and the remaining axis r indexes batches of tiles.
+  const int r = 3 - p;
+  int dims[] = { a1, a2, a3 };
+  int a_strides[] = { 1, a1, a1 * a2 };
+  int b_strides[] = { bs0, bs1, bs2 };
+
+  // Tiles are visited along diagonals, so that concurrent work groups
+  // spread their accesses over every memory partition.
+  int groups0 = get_num_groups (0);
+  int groups1 = get_num_groups (1);
+  int id = get_group_id (0) + groups0 * get_group_id (1);
+  int tile_p = id - (id / groups1) * groups1;
+  int tile_0 = id / groups1 + tile_p;
+  tile_0 -= (tile_0 / groups0) * groups0;
+  int ur = get_global_id (2);
 
   __local % s A_tile[tile_size][tile_size + 1];
 
-  if (col < a1 && row < a2)
+  for (int i = 0; i < wpt; i++)
     {
-      A_tile[local_row][local_col] = A[row * a1 + col];
+      int u0 = tile_0 * tile_size + local_col;
+      int up = tile_p * tile_size + local_row + i * rows;
+      if (u0 < a1 && up < dims[p])
+        {
+          A_tile[local_row + i * rows][local_col]
+              = A[u0 + up * a_strides[p] + ur * a_strides[r]];
+        }
     }
   barrier (CLK_LOCAL_MEM_FENCE);
 
-  int transposed_col = get_group_id (1) * tile_size + local_col;
-  int transposed_row = get_group_id (0) * tile_size + local_row;
+  for (int i = 0; i < wpt; i++)
+    {
+      int up = tile_p * tile_size + local_col;
+      int u0 = tile_0 * tile_size + local_row + i * rows;
+      if (u0 < a1 && up < dims[p])
+        {
+          B[u0 * bs0 + up + ur * b_strides[r]]
+              = A_tile[local_col][local_row + i * rows];
+        }
+    }
+});
+
+/* Format strings:
+** 1. A type
+** 2. B type
+** 3. TILE_SIZE
+** 4. work per thread
+*/
+const char *_permute_fmt = RAW (__kernel void entry (
+    const int a1, const int a2, const int a3, __global const % s * A,
+    const int b1, const int b2, const int b3, __global % s * B,
+    const int bs0, const int bs1, const int bs2) {
+  int j = get_global_id (1);
+  int k = get_global_id (2);
+  const int tile_size = % d;
+  const int wpt = % d;
+
+  // The fast axis stays in place, so both sides are accessed contiguously.
+  for (int w = 0; w < wpt; w++)
+    {
+      int i = get_group_id (0) * tile_size * wpt + w * tile_size
+              + get_local_id (0);
+      if (i < a1)
+        {
+          B[i + j * bs1 + k * bs2] = A[(k * a2 + j) * a1 + i];
+        }
+    }
+});
+
+/* Format strings:
+** 1. A type
+** 2. TILE_SIZE
+** 3. work per thread
+** 4. upper_tile type
+** 5. lower_tile type
+*/
+const char *_transpose_square_fmt = RAW (__kernel void entry (
+    const int a1, const int a2, const int a3, __global % s * A) {
+  int local_row = get_local_id (1);
+  int local_col = get_local_id (0);
+  int tile_row = get_group_id (1);
+  int tile_col = get_group_id (0);
+  const int tile_size = % d;
+  const int wpt = % d;
+  const int rows = tile_size / wpt;
+
+  // Each work group above the diagonal swaps its tile with the mirrored one
+  // below, transposing both, and groups on the diagonal transpose theirs.
+  if (tile_row > tile_col)
+    {
+      return;
+    }
+  A += get_global_id (2) * a1 * a2;
+
+  __local % s upper_tile[tile_size][tile_size + 1];
+  __local % s lower_tile[tile_size][tile_size + 1];
+
+  for (int i = 0; i < wpt; i++)
+    {
+      int r = local_row + i * rows;
+      int row = tile_row * tile_size + r;
+      int col = tile_col * tile_size + local_col;
+      if (row < a1 && col < a1)
+        {
+          upper_tile[r][local_col] = A[row * a1 + col];
+        }
+      row = tile_col * tile_size + r;
+      col = tile_row * tile_size + local_col;
+      if (row < a1 && col < a1)
+        {
+          lower_tile[r][local_col] = A[row * a1 + col];
+        }
+    }
+  barrier (CLK_LOCAL_MEM_FENCE);
+
+  for (int i = 0; i < wpt; i++)
+    {
+      int r = local_row + i * rows;
+      int row = tile_row * tile_size + r;
+      int col = tile_col * tile_size + local_col;
+      if (row < a1 && col < a1)
+        {
+          A[row * a1 + col] = lower_tile[local_col][r];
+        }
+      row = tile_col * tile_size + r;
+      col = tile_row * tile_size + local_col;
+      if (row < a1 && col < a1)
+        {
+          A[row * a1 + col] = upper_tile[local_col][r];
+        }
+    }
+});
+
+/*
+** Rectangular matrices are transposed by the decomposition of Catanzaro,
+** Keller and Garland into a rotation of columns, a shuffle within each row
+** and a shuffle within each column. Every pass permutes lines independently,
+** so a batch of lines is gathered into scratch memory and copied back.
+*/
+
+/* Format strings:
+** 1. A type
+** 2. S type
+** 3. pass
+** 4. a
+** 5. b
+*/
+const char *_transpose_rectangular_fmt = RAW (__kernel void entry (
+    const int a1, const int a2, const int a3, __global % s * A,
+    const int s1, const int s2, const int s3, __global % s * S,
+    const int offset, const int first, const int count, const int phase) {
+  const int pass = % d;
+  const int a = % d;
+  const int b = % d;
+  const int m = a2;
+  const int n = a1;
+
+  // Rows are contiguous along x, columns are contiguous across lines.
+  int l = pass == 1 ? get_global_id (1) : get_global_id (0);
+  int x = pass == 1 ? get_global_id (0) : get_global_id (1);
+  int line = first + l;
+  A += offset;
 
-  if (transposed_col < a2 && transposed_row < a1)
+  if (pass == 0 && l < count && x < m)
     {
-      B[transposed_row * b1 + transposed_col] = A_tile[local_col][local_row];
+      if (phase == 0)
+        {
+          int src = x + line / b;
+          src -= (src / m) * m;
+          S[x * count + l] = A[src * n + line];
+        }
+      else
+        {
+          A[x * n + line] = S[x * count + l];
+        }
+    }
+  else if (pass == 1 && l < count && x < n)
+    {
+      if (phase == 0)
+        {
+          int d = line + x / b;
+          d -= (d / m) * m;
+          d += x * m;
+          d -= (d / n) * n;
+          S[l * n + d] = A[line * n + x];
+        }
+      else
+        {
+          A[line * n + x] = S[l * n + x];
+        }
+    }
+  else if (pass == 2 && l < count && x < m)
+    {
+      if (phase == 0)
+        {
+          int src = line + x * n - x / a;
+          src -= (src / m) * m;
+          S[x * count + l] = A[src * n + line];
+        }
+      else
+        {
+          A[x * n + line] = S[x * count + l];
+        }
     }
 });
 
+static int
+get_transpose_work_per_thread (void)
+{
+  return _tile_size % TRANSPOSE_WORK_PER_THREAD == 0
+             ? TRANSPOSE_WORK_PER_THREAD
+             : 1;
+}
+
 char *
-get_transpose (const char *dtype)
+get_transpose (const char *dtype, int axis)
 {
-  int size
-      = snprintf (NULL, 0, _transpose_fmt, dtype, dtype, _tile_size, dtype);
+  int wpt = get_transpose_work_per_thread ();
+  int size = snprintf (NULL, 0, _transpose_fmt, dtype, dtype, _tile_size, wpt,
+                       axis, dtype);
 
   char *kernel = malloc (size + 1);
   if (!kernel)
@@ -48,7 +256,74 @@ get_transpose (const char *dtype)
     }
 
   int count = snprintf (kernel, size + 1, _transpose_fmt, dtype, dtype,
-                        _tile_size, dtype);
+                        _tile_size, wpt, axis, dtype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+char *
+get_permute (const char *dtype)
+{
+  int size = snprintf (NULL, 0, _permute_fmt, dtype, dtype, _tile_size,
+                       TRANSPOSE_WORK_PER_THREAD);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _permute_fmt, dtype, dtype,
+                        _tile_size, TRANSPOSE_WORK_PER_THREAD);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+char *
+get_transpose_square (const char *dtype)
+{
+  int wpt = get_transpose_work_per_thread ();
+  int size = snprintf (NULL, 0, _transpose_square_fmt, dtype, _tile_size, wpt,
+                       dtype, dtype);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _transpose_square_fmt, dtype,
+                        _tile_size, wpt, dtype, dtype);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+char *
+get_transpose_rectangular (const char *dtype, int pass, int a, int b)
+{
+  int size = snprintf (NULL, 0, _transpose_rectangular_fmt, dtype, dtype,
+                       pass, a, b);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _transpose_rectangular_fmt, dtype,
+                        dtype, pass, a, b);
   if (count == -1)
     {
       handle_error ("Failed to print to kernel string");
@@ -58,21 +333,108 @@ get_transpose (const char *dtype)
 }
 
 unsigned long long
-transpose (array A, array B, cl_event *event)
+permute (int axis1, int axis2, int axis3, array A, array B, cl_event *event)
 {
   cl_event _event;
+  int axes[] = { axis1, axis2, axis3 };
+  int a_dims[] = { A.dim1, A.dim2, A.dim3 };
+  int b_dims[] = { B.dim1, B.dim2, B.dim3 };
+  int b_strides[] = { 1, B.dim1, B.dim1 * B.dim2 };
+  int seen = 0;
+  for (int d = 0; d < 3; d++)
+    {
+      if (axes[d] >= 0 && axes[d] < 3)
+        seen |= 1 << axes[d];
+    }
+  if (seen != 7)
+    {
+      handle_error ("Axes %d, %d, %d are not a permutation of 0, 1, 2",
+                    axis1, axis2, axis3);
+      return 0;
+    }
+  for (int d = 0; d < 3; d++)
+    {
+      if (b_dims[d] != a_dims[axes[d]])
+        {
+          handle_error ("Cannot permute %dx%dx%d array into %dx%dx%d",
+                        A.dim1, A.dim2, A.dim3, B.dim1, B.dim2, B.dim3);
+          return 0;
+        }
+    }
+
+  // Strides in B of each axis of A.
+  int bs[3];
+  for (int d = 0; d < 3; d++)
+    {
+      bs[axes[d]] = b_strides[d];
+    }
+
   const char *dtype = TYPE_STR_FROM_ENUM (B.type);
-  char *src = get_transpose (dtype);
+  char *src = axes[0] ? get_transpose (dtype, axes[0]) : get_permute (dtype);
+  cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+  free (src);
+  int idx = SET_KERNEL_ARGS (kernel, A, B);
+  for (int d = 0; d < 3; d++)
+    {
+      CHECK_CL (clSetKernelArg (kernel, idx++, sizeof (int), &bs[d]));
+    }
+
+  if (axes[0])
+    {
+      int wpt = get_transpose_work_per_thread ();
+      size_t local_size[] = { _tile_size, _tile_size / wpt, 1 };
+      size_t global_size[]
+          = { LOWEST_MULTIPLE_OF_TILE (A.dim1),
+              LOWEST_MULTIPLE_OF_TILE (a_dims[axes[0]]) / wpt,
+              a_dims[3 - axes[0]] };
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                        local_size, 0, NULL,
+                                        event ? event : &_event));
+    }
+  else
+    {
+      int block = _tile_size * TRANSPOSE_WORK_PER_THREAD;
+      size_t local_size[] = { _tile_size, 1, 1 };
+      size_t global_size[]
+          = { ((A.dim1 + block - 1) / block) * _tile_size, A.dim2, A.dim3 };
+      CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                        local_size, 0, NULL,
+                                        event ? event : &_event));
+    }
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    return time;
+
+  time = GET_CL_EVENT_TIME (_event);
+
+  return time;
+}
+
+unsigned long long
+transpose (array A, array B, cl_event *event)
+{
+  return permute (1, 0, 2, A, B, event);
+}
+
+static unsigned long long
+transpose_square (array A, cl_event *event)
+{
+  cl_event _event;
+  char *src = get_transpose_square (TYPE_STR_FROM_ENUM (A.type));
   cl_kernel kernel = TRY_COMPILE_KERNEL (src);
   free (src);
-  SET_KERNEL_ARGS (kernel, A, B);
-
-  size_t local_size[] = { _tile_size, _tile_size, _tile_size };
-  size_t global_size[]
-      = { LOWEST_MULTIPLE_OF_TILE (B.dim1), LOWEST_MULTIPLE_OF_TILE (B.dim2),
-          LOWEST_MULTIPLE_OF_TILE (B.dim3) };
-  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, ARRAY_NUM_DIMS (B), NULL,
-                                    global_size, local_size, 0, NULL,
+  SET_KERNEL_ARGS (kernel, A);
+
+  int wpt = get_transpose_work_per_thread ();
+  size_t local_size[] = { _tile_size, _tile_size / wpt, 1 };
+  size_t global_size[] = { LOWEST_MULTIPLE_OF_TILE (A.dim1),
+                           LOWEST_MULTIPLE_OF_TILE (A.dim2) / wpt, A.dim3 };
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel, 3, NULL, global_size,
+                                    local_size, 0, NULL,
                                     event ? event : &_event));
 
   unsigned long long time = 0;
@@ -86,3 +448,102 @@ transpose (array A, array B, cl_event *event)
 
   return time;
 }
+
+static int
+transpose_gcd (int x, int y)
+{
+  while (y)
+    {
+      int t = x - (x / y) * y;
+      x = y;
+      y = t;
+    }
+  return x;
+}
+
+/*
+** Launches are many and run in order, so each is timed as it completes when
+** profiling, and a single marker stands for all of them otherwise.
+*/
+static unsigned long long
+transpose_rectangular (array A, cl_event *event)
+{
+  int n = A.dim1;
+  int m = A.dim2;
+  int c = transpose_gcd (m, n);
+  int length = m > n ? m : n;
+  int lines_per_batch = (m * n / TRANSPOSE_IN_PLACE_SCRATCH_FRACTION) / length;
+  lines_per_batch = lines_per_batch < 1 ? 1 : lines_per_batch;
+  lines_per_batch = lines_per_batch > length ? length : lines_per_batch;
+  array S = alloc_array (A.type, CL_MEM_READ_WRITE, lines_per_batch * length,
+                         1, 1);
+
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  int timing = !event && (props & CL_QUEUE_PROFILING_ENABLE);
+
+  unsigned long long time = 0;
+  const char *dtype = TYPE_STR_FROM_ENUM (A.type);
+  for (int pass = c > 1 ? 0 : 1; pass < 3; pass++)
+    {
+      char *src = get_transpose_rectangular (dtype, pass, m / c, n / c);
+      cl_kernel kernel = TRY_COMPILE_KERNEL (src);
+      free (src);
+      int idx = SET_KERNEL_ARGS (kernel, A, S);
+
+      int lines = pass == 1 ? m : n;
+      int along = pass == 1 ? n : m;
+      for (int k = 0; k < A.dim3; k++)
+        {
+          int offset = k * m * n;
+          for (int first = 0; first < lines; first += lines_per_batch)
+            {
+              int count = lines - first < lines_per_batch ? lines - first
+                                                          : lines_per_batch;
+              size_t local_size[] = { _tile_size, 1 };
+              size_t global_size[]
+                  = { LOWEST_MULTIPLE_OF_TILE (pass == 1 ? along : count),
+                      pass == 1 ? count : along };
+              CHECK_CL (clSetKernelArg (kernel, idx, sizeof (int), &offset));
+              CHECK_CL (
+                  clSetKernelArg (kernel, idx + 1, sizeof (int), &first));
+              CHECK_CL (
+                  clSetKernelArg (kernel, idx + 2, sizeof (int), &count));
+              for (int phase = 0; phase < 2; phase++)
+                {
+                  cl_event partial;
+                  CHECK_CL (clSetKernelArg (kernel, idx + 3, sizeof (int),
+                                            &phase));
+                  CHECK_CL (clEnqueueNDRangeKernel (
+                      _queue, kernel, 2, NULL, global_size, local_size, 0,
+                      NULL, timing ? &partial : NULL));
+                  if (timing)
+                    {
+                      time += GET_CL_EVENT_TIME (partial);
+                      CHECK_CL (clReleaseEvent (partial));
+                    }
+                }
+            }
+        }
+    }
+  FREE_ARRAY (S);
+
+  if (!timing)
+    CHECK_CL (clEnqueueMarkerWithWaitList (_queue, 0, NULL, event));
+
+  return time;
+}
+
+unsigned long long
+transpose_in_place (array *A, cl_event *event)
+{
+  unsigned long long time = A->dim1 == A->dim2
+                                ? transpose_square (*A, event)
+                                : transpose_rectangular (*A, event);
+  int dim1 = A->dim1;
+  A->dim1 = A->dim2;
+  A->dim2 = dim1;
+
+  return time;
+}
@@ -7,28 +7,129 @@
 
 #include "cl_utils.h"
 
+/**
+ * @brief Fraction of a rectangular matrix used as scratch memory by
+ * @ref transpose_in_place, can be overriden.
+ *
+ * Lines are permuted in batches whose scratch memory holds at most this
+ * fraction of the elements of a matrix, and at least one line.
+ */
+#ifndef TRANSPOSE_IN_PLACE_SCRATCH_FRACTION
+#define TRANSPOSE_IN_PLACE_SCRATCH_FRACTION 16
+#endif
+
 extern const char *_transpose_fmt;
+extern const char *_permute_fmt;
+extern const char *_transpose_square_fmt;
+extern const char *_transpose_rectangular_fmt;
 /**
  * @brief Composes transpose kernel.
  *
- * Constructs the kernel with the specified types and operations, return an
+ * Constructs the kernel with the specified type, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the second input argument B, A is written with its first axis and the
+ * given axis swapped through a tile in local memory, and the remaining axis
+ * moved to the position given by the strides in B of each axis of A. Tiles
+ * are visited in diagonal order, and each work item moves several elements.
+ *
+ * @param dtype String for type of both @ref array "arrays" of kernel.
+ * @param axis Axis of A that becomes the first axis of B, 1 or 2.
+ * @return Pointer to null-terminated string.
+ */
+char *get_transpose (const char *dtype, int axis);
+/**
+ * @brief Composes permute kernel.
+ *
+ * Constructs the kernel with the specified type, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the second input argument B, A is written with its second and third
+ * axes moved to the positions given by the strides in B of each axis of A,
+ * keeping the first axis in place.
+ *
+ * @param dtype String for type of both @ref array "arrays" of kernel.
+ * @return Pointer to null-terminated string.
+ */
+char *get_permute (const char *dtype);
+/**
+ * @brief Composes in place square transpose kernel.
+ *
+ * Constructs the kernel with the specified type, return an allocated
+ * null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Transposes each square matrix of the input argument A in place, swapping
+ * each tile above the diagonal with its mirror below through local memory.
+ *
+ * @param dtype String for type of the @ref array of kernel.
+ * @return Pointer to null-terminated string.
+ */
+char *get_transpose_square (const char *dtype);
+/**
+ * @brief Composes in place rectangular transpose pass kernel.
+ *
+ * Constructs the kernel with the specified type and pass, return an
  * allocated null-terminated string containing the kernel.
  *
  * The caller is responsible for freeing the string.
  *
- * Onto the second input argument B, the transposition of A is written.
+ * Permutes a batch of lines of the matrix at the given offset of the first
+ * input argument A, gathering them into the scratch memory S in the first
+ * phase and copying them back in the second. Pass 0 rotates columns, pass 1
+ * shuffles rows, and pass 2 shuffles columns, after which A holds its
+ * transpose.
  *
- * @param atype String for type of first @ref array of kernel: A.
- * @param btype String for type of second @ref array of kernel: B.
+ * @param dtype String for type of both @ref array "arrays" of kernel.
+ * @param pass Pass of the transposition, from 0 to 2.
+ * @param a Rows of the matrix divided by their gcd with its columns.
+ * @param b Columns of the matrix divided by their gcd with its rows.
  * @return Pointer to null-terminated string.
  */
-char *get_transpose (const char *dtype);
+char *get_transpose_rectangular (const char *dtype, int pass, int a, int b);
+/**
+ * @brief Perform permute operation.
+ *
+ * Writes into B the axes of A in the given order, so that the first axis of
+ * B is axis1 of A and so on, with axes numbered from 0. B has the permuted
+ * dimensions of A. Blocks and attempts to record timing if no cl_event is
+ * provided, non blocking otherwise.
+ *
+ * @param axis1 Axis of A that becomes the first axis of B.
+ * @param axis2 Axis of A that becomes the second axis of B.
+ * @param axis3 Axis of A that becomes the third axis of B.
+ * @param A @ref array to permute.
+ * @param B @ref array to write into.
+ * @param event cl_event to be attached to the kernel call.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Channels last (C, W, H) into channels first (W, H, C)
+ * array B = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, A.dim2, A.dim3, A.dim1);
+ * PERMUTE(1, 2, 0, A, B);
+ * @endcode
+ */
+unsigned long long permute (int axis1, int axis2, int axis3, array A, array B,
+                            cl_event *event);
+#define _PERMUTE_ONE(axis1, axis2, axis3, A, B)                               \
+  permute (axis1, axis2, axis3, A, B, NULL);
+#define _PERMUTE_TWO(axis1, axis2, axis3, A, B, event)                        \
+  permute (axis1, axis2, axis3, A, B, event)
+#define PERMUTE(...)                                                          \
+  _GETM_SIX (__VA_ARGS__, _PERMUTE_TWO, _PERMUTE_ONE) (                       \
+      __VA_ARGS__) /**< @copydoc permute*/
 /**
  * @brief Perform transpose operation.
  *
- * Calls transpose kernel on given input @ref array "arrays". Blocks and
- * attempts to record timing if no cl_event is provided, non blocking
- * otherwise.
+ * Transposes each matrix stacked along the third dimension of A into B, as
+ * @ref permute with axes 1, 0, 2. Blocks and attempts to record timing if no
+ * cl_event is provided, non blocking otherwise.
  *
  * @param A First argument @ref array of the kernel.
  * @param B Second argument @ref array of the kernel.
@@ -49,4 +150,32 @@ unsigned long long transpose (array A, array B, cl_event *event);
   _GETM_THREE (__VA_ARGS__, _TRANSPOSE_TWO,                                   \
                _TRANSPOSE_ONE) (__VA_ARGS__) /**< @copydoc transpose*/
 
+/**
+ * @brief Perform in place transpose operation.
+ *
+ * Transposes each matrix stacked along the third dimension of A in place and
+ * swaps the first two dimensions of A. Square matrices swap tiles directly,
+ * and rectangular ones take three passes over batches of lines, using at
+ * most 1 / TRANSPOSE_IN_PLACE_SCRATCH_FRACTION of a matrix of scratch
+ * memory. Blocks and attempts to record timing if no cl_event is provided,
+ * non blocking otherwise.
+ *
+ * @param A Pointer to the @ref array to transpose.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // A is now A.dim2 x A.dim1
+ * TRANSPOSE_IN_PLACE(A);
+ * @endcode
+ */
+unsigned long long transpose_in_place (array *A, cl_event *event);
+#define _TRANSPOSE_IN_PLACE_ONE(A) transpose_in_place (&(A), NULL);
+#define _TRANSPOSE_IN_PLACE_TWO(A, event) transpose_in_place (&(A), event)
+#define TRANSPOSE_IN_PLACE(...)                                               \
+  _GETM_TWO (__VA_ARGS__, _TRANSPOSE_IN_PLACE_TWO,                            \
+             _TRANSPOSE_IN_PLACE_ONE) (                                       \
+      __VA_ARGS__) /**< @copydoc transpose_in_place*/
+
 #endif // TRANSPOSE_H_
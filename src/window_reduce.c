@@ -0,0 +1,323 @@
+#include "window_reduce.h"
+#include "cl_utils.h"
+#include <stdio.h>
+
+/* Format strings:
+** 1. A type
+** 2. P type
+** 3. S type
+** 4. TILE_SIZE
+** 5. axis
+** 6. window
+** 7. span
+** 8. A_tile type
+** 9. carry type
+** 10. value type
+** 11. a type
+** 12. b type
+** 13. OP1
+** 14. a type
+** 15. b type
+** 16. OP1
+** 17. value type
+** 18. a type
+** 19. b type
+** 20. OP1
+** 21. a type
+** 22. b type
+** 23. OP1
+*/
+const char *_window_scan_fmt = RAW (__kernel void entry (
+    const int a1, const int a2, const int a3, __global const % s * A,
+    const int p1, const int p2, const int p3, __global % s * P,
+    const int s1, const int s2, const int s3, __global % s * S) {
+  int local_row = get_local_id (1);
+  int local_col = get_local_id (0);
+  const int tile_size = % d;
+  const int axis = % d;
+  const int window = % d;
+  const int span = % d;
+
+  // Lanes are lines along the axis and positions run along them, so memory
+  // accesses stay contiguous across local_col for any axis.
+  int lane = axis ? local_col : local_row;
+  int pos = axis ? local_row : local_col;
+  int line = get_group_id (axis ? 0 : 1) * tile_size + lane;
+  int length = axis == 0 ? a1 : axis == 1 ? a2 : a3;
+  int lines = (a1 * a2 * a3) / length;
+  int stride = axis == 0 ? 1 : axis == 1 ? a1 : a1 * a2;
+  int base = axis == 0   ? line * a1
+             : axis == 1 ? (line / a1) * a1 * a2 + line - (line / a1) * a1
+                         : line;
+
+  // Spans hold whole blocks, so work groups never share a block.
+  int segment = get_group_id (axis ? 1 : 0) * span;
+  int end = min (segment + span, length);
+
+  __local % s A_tile[tile_size][tile_size + 1];
+  __local % s carry[tile_size];
+
+  for (int start = segment; start < end; start += tile_size)
+    {
+      int along = start + pos;
+      int block = along / window;
+      int inside = along < end && line < lines;
+      if (inside)
+        {
+          A_tile[lane][pos] = A[base + along * stride];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      for (int offset = 1; offset < tile_size; offset *= 2)
+        {
+          % s value = A_tile[lane][pos];
+          if (pos >= offset && (along - offset) / window == block)
+            {
+              % s a = A_tile[lane][pos - offset];
+              % s b = value;
+              value = % s;
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+          A_tile[lane][pos] = value;
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+
+      if (start > segment && (start - 1) / window == block)
+        {
+          % s a = carry[lane];
+          % s b = A_tile[lane][pos];
+          A_tile[lane][pos] = % s;
+        }
+      if (inside)
+        {
+          P[base + along * stride] = A_tile[lane][pos];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      if (pos == tile_size - 1)
+        {
+          carry[lane] = A_tile[lane][pos];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+    }
+
+  // Sweep back over the same tiles for the scans from the end of each block.
+  int last = segment + ((end - segment - 1) / tile_size) * tile_size;
+  for (int start = last; start >= segment; start -= tile_size)
+    {
+      int along = start + pos;
+      int block = along / window;
+      int inside = along < end && line < lines;
+      if (inside)
+        {
+          A_tile[lane][pos] = A[base + along * stride];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      for (int offset = 1; offset < tile_size; offset *= 2)
+        {
+          % s value = A_tile[lane][pos];
+          if (pos + offset < tile_size && along + offset < end
+              && (along + offset) / window == block)
+            {
+              % s a = value;
+              % s b = A_tile[lane][pos + offset];
+              value = % s;
+            }
+          barrier (CLK_LOCAL_MEM_FENCE);
+          A_tile[lane][pos] = value;
+          barrier (CLK_LOCAL_MEM_FENCE);
+        }
+
+      if (start < last && (start + tile_size) / window == block)
+        {
+          % s a = A_tile[lane][pos];
+          % s b = carry[lane];
+          A_tile[lane][pos] = % s;
+        }
+      if (inside)
+        {
+          S[base + along * stride] = A_tile[lane][pos];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+
+      if (pos == 0)
+        {
+          carry[lane] = A_tile[lane][pos];
+        }
+      barrier (CLK_LOCAL_MEM_FENCE);
+    }
+});
+
+/* Format strings:
+** 1. P type
+** 2. S type
+** 3. B type
+** 4. axis
+** 5. window
+** 6. a type
+** 7. b type
+** 8. OP1
+*/
+const char *_window_combine_fmt = RAW (__kernel void entry (
+    const int p1, const int p2, const int p3, __global const % s * P,
+    const int s1, const int s2, const int s3, __global const % s * S,
+    const int b1, const int b2, const int b3, __global % s * B) {
+  int i = get_global_id (0);
+  int j = get_global_id (1);
+  int k = get_global_id (2);
+  const int axis = % d;
+  const int window = % d;
+
+  if (i < b1 && j < b2 && k < b3)
+    {
+      int along = axis == 0 ? i : axis == 1 ? j : k;
+      int stride = axis == 0 ? 1 : axis == 1 ? p1 : p1 * p2;
+      int id = (k * p2 + j) * p1 + i;
+      if (along - (along / window) * window == 0)
+        {
+          B[(k * b2 + j) * b1 + i] = S[id];
+        }
+      else
+        {
+          % s a = S[id];
+          % s b = P[id + (window - 1) * stride];
+          B[(k * b2 + j) * b1 + i] = % s;
+        }
+    }
+});
+
+char *
+get_window_scan (const char *atype, const char *ptype, const char *op1,
+                 int axis, int window, int span)
+{
+  int size = snprintf (NULL, 0, _window_scan_fmt, atype, ptype, ptype,
+                       _tile_size, axis, window, span, ptype, ptype, ptype,
+                       ptype, ptype, op1, ptype, ptype, op1, ptype, ptype,
+                       ptype, op1, ptype, ptype, op1);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _window_scan_fmt, atype, ptype,
+                        ptype, _tile_size, axis, window, span, ptype, ptype,
+                        ptype, ptype, ptype, op1, ptype, ptype, op1, ptype,
+                        ptype, ptype, op1, ptype, ptype, op1);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+char *
+get_window_combine (const char *ptype, const char *btype, const char *op1,
+                    int axis, int window)
+{
+  int size = snprintf (NULL, 0, _window_combine_fmt, ptype, ptype, btype, axis,
+                       window, ptype, ptype, op1);
+
+  char *kernel = malloc (size + 1);
+  if (!kernel)
+    {
+      handle_error ("Failed to allocate memory for kernel string");
+    }
+
+  int count = snprintf (kernel, size + 1, _window_combine_fmt, ptype, ptype,
+                        btype, axis, window, ptype, ptype, op1);
+  if (count == -1)
+    {
+      handle_error ("Failed to print to kernel string");
+    }
+
+  return kernel;
+}
+
+unsigned long long
+window_reduce (const char *op1, int window, int axis, array A, array B,
+               cl_event *event)
+{
+  int dims[] = { A.dim1, A.dim2, A.dim3 };
+  if (axis < 0 || axis > 2)
+    {
+      handle_error ("Invalid window axis %d", axis);
+      return 0;
+    }
+  if (window < 1 || window > dims[axis])
+    {
+      handle_error ("Invalid window of %d elements along %d", window,
+                    dims[axis]);
+      return 0;
+    }
+  dims[axis] -= window - 1;
+  if (B.dim1 != dims[0] || B.dim2 != dims[1] || B.dim3 != dims[2])
+    {
+      handle_error ("Window reduction into %dx%dx%d array, expected %dx%dx%d",
+                    B.dim1, B.dim2, B.dim3, dims[0], dims[1], dims[2]);
+      return 0;
+    }
+
+  // Scans from either end of each block are kept in B's type.
+  array P = alloc_array (B.type, CL_MEM_READ_WRITE, A.dim1, A.dim2, A.dim3);
+  array S = alloc_array (B.type, CL_MEM_READ_WRITE, A.dim1, A.dim2, A.dim3);
+
+  const char *ptype = TYPE_STR_FROM_ENUM (B.type);
+  int span = window < _tile_size
+                 ? ((_tile_size + window - 1) / window) * window
+                 : window;
+  char *src_scan = get_window_scan (TYPE_STR_FROM_ENUM (A.type), ptype, op1,
+                                    axis, window, span);
+  cl_kernel kernel_scan = TRY_COMPILE_KERNEL (src_scan);
+  free (src_scan);
+  SET_KERNEL_ARGS (kernel_scan, A, P, S);
+
+  char *src_combine = get_window_combine (ptype, ptype, op1, axis, window);
+  cl_kernel kernel_combine = TRY_COMPILE_KERNEL (src_combine);
+  free (src_combine);
+  SET_KERNEL_ARGS (kernel_combine, P, S, B);
+
+  int length = axis == 0 ? A.dim1 : axis == 1 ? A.dim2 : A.dim3;
+  int lines = ARRAY_SIZE (A) / length;
+  int spans = (length + span - 1) / span;
+  size_t local_size[] = { _tile_size, _tile_size, 1 };
+  size_t scan_global_size[]
+      = { axis ? LOWEST_MULTIPLE_OF_TILE (lines) : spans * _tile_size,
+          axis ? spans * _tile_size : LOWEST_MULTIPLE_OF_TILE (lines) };
+  size_t combine_local_size[] = { _tile_size, 1, 1 };
+  size_t combine_global_size[]
+      = { LOWEST_MULTIPLE_OF_TILE (B.dim1), B.dim2, B.dim3 };
+
+  cl_event partials[2];
+  int event_count = 0;
+  CHECK_CL (clEnqueueNDRangeKernel (_queue, kernel_scan, 2, NULL,
+                                    scan_global_size, local_size, 0, NULL,
+                                    &partials[event_count++]));
+  CHECK_CL (clEnqueueNDRangeKernel (
+      _queue, kernel_combine, 3, NULL, combine_global_size, combine_local_size,
+      0, NULL, &partials[event_count++]));
+
+  FREE_ARRAY (P);
+  FREE_ARRAY (S);
+
+  unsigned long long time = 0;
+  cl_command_queue_properties props = 0;
+  CHECK_CL (clGetCommandQueueInfo (_queue, CL_QUEUE_PROPERTIES, sizeof (props),
+                                   &props, NULL));
+  if (event || !(props & CL_QUEUE_PROFILING_ENABLE))
+    {
+      CHECK_CL (
+          clEnqueueMarkerWithWaitList (_queue, event_count, partials, event));
+      return time;
+    }
+
+  for (int i = 0; i < event_count; i++)
+    {
+      time += GET_CL_EVENT_TIME (partials[i]);
+    }
+
+  return time;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file window_reduce.h
+ */
+
+#ifndef WINDOW_REDUCE_H_
+#define WINDOW_REDUCE_H_
+
+#include "cl_utils.h"
+
+extern const char *_window_scan_fmt;
+extern const char *_window_combine_fmt;
+/**
+ * @brief Composes window block scan kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Splits each line of A along the given axis into blocks of window elements,
+ * writing into P the scan of each block from its start and into S the scan
+ * from its end. Each work group sweeps a span of whole blocks across tile
+ * size lines one tile at a time in local memory. Variables `a` and `b` hold
+ * the earlier and later of the pair being combined.
+ *
+ * @param atype String for type of first @ref array of kernel: A.
+ * @param ptype String for type of the scratch @ref array "arrays" P and S.
+ * @param op1 String for the operation the kernel performs.
+ * @param axis Dimension along which windows slide, from 0 to 2.
+ * @param window Number of elements in each window.
+ * @param span Number of elements along the axis swept by each work group.
+ * @return Pointer to null-terminated string.
+ */
+char *get_window_scan (const char *atype, const char *ptype, const char *op1,
+                       int axis, int window, int span);
+/**
+ * @brief Composes window combination kernel.
+ *
+ * Constructs the kernel with the specified types and operations, return an
+ * allocated null-terminated string containing the kernel.
+ *
+ * The caller is responsible for freeing the string.
+ *
+ * Onto the third input argument B, the reduction of each window is written
+ * by combining the scan from its start to the end of its block in S with the
+ * scan from the start of the next block up to its end in P.
+ *
+ * @param ptype String for type of the scratch @ref array "arrays" P and S.
+ * @param btype String for type of third @ref array of kernel: B.
+ * @param op1 String for the operation the kernel performs.
+ * @param axis Dimension along which windows slide, from 0 to 2.
+ * @param window Number of elements in each window.
+ * @return Pointer to null-terminated string.
+ */
+char *get_window_combine (const char *ptype, const char *btype,
+                          const char *op1, int axis, int window);
+/**
+ * @brief Perform sliding window reduction.
+ *
+ * Reduces every window of consecutive elements of A along the given axis with
+ * the operation, writing the result for the window starting at each index
+ * into B. B has the dimensions of A, except that along the axis it is window
+ * minus one elements shorter. Uses the van Herk/Gil-Werman method, so the
+ * cost per element does not depend on the window size, and any associative
+ * operation can be used. Within the operation `a` precedes `b`. Blocks and
+ * attempts to record timing if no cl_event is provided, non blocking
+ * otherwise.
+ *
+ * @param op1 String of operation to perform.
+ * @param window Number of elements in each window.
+ * @param axis Dimension along which windows slide, from 0 to 2.
+ * @param A @ref array to reduce.
+ * @param B @ref array to write the reductions into.
+ * @param event cl_event to be attached to the kernel calls.
+ * @return Nanoseconds taken, or 0 if not timing or queue profiling disabled.
+ *
+ * Example usage:
+ * @code
+ * // Rolling mean over 8 frames along the third dimension
+ * array S = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, w, h, frames - 7);
+ * WINDOW_REDUCE("a + b", 8, 2, video, S);
+ * MAP("a / 8", S, S);
+ * // Rolling maximum over 64 samples of each row of series
+ * cl_event event;
+ * array M = ALLOC_ARRAY (float, CL_MEM_READ_WRITE, n - 63, rows);
+ * WINDOW_REDUCE("max (a, b)", 64, 0, series, M, &event);
+ * clWaitForEvents(1, &event);
+ * @endcode
+ */
+unsigned long long window_reduce (const char *op1, int window, int axis,
+                                  array A, array B, cl_event *event);
+#define _WINDOW_REDUCE_ONE(op1, window, axis, A, B)                           \
+  window_reduce (op1, window, axis, A, B, NULL);
+#define _WINDOW_REDUCE_TWO(op1, window, axis, A, B, event)                    \
+  window_reduce (op1, window, axis, A, B, event)
+#define WINDOW_REDUCE(...)                                                    \
+  _GETM_SIX (__VA_ARGS__, _WINDOW_REDUCE_TWO,                                 \
+             _WINDOW_REDUCE_ONE) (__VA_ARGS__) /**< @copydoc window_reduce*/
+
+#endif // WINDOW_REDUCE_H_